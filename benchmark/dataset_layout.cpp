@@ -0,0 +1,170 @@
+/*
+	Time of the row-oriented fit / predict paths on the same data stored as a
+	column-major MatrixXf and as a row-major, padded Dataset, so that the
+	difference is the layout alone. Every case is the best of --repeats runs
+	and checks that both layouts give the same result.
+
+	g++ benchmark/dataset_layout.cpp --std=c++17 -O2 -pthread -o dataset_layout
+	./dataset_layout --n=200000 --d=20 --k=5
+
+	Options (defaults in brackets)
+		--n            rows [100000]
+		--d            features [20]
+		--k            clusters / classes [5]
+		--knn-queries  rows predicted by KNN [100]
+		--repeats      runs per case [3]
+		--seed         generator seed [42]
+
+	KMeans and GaussianMixture fit are reported per iteration, because the
+	k-means++ start (and so the number of iterations) differs from run to run;
+	their results are not compared ("-"), their predict on one model is.
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "../headers/synthetic_data.h"
+#include "../headers/dataset.h"
+#include "../headers/k_nearest_neighbors.h"
+#include "../headers/k_means.h"
+#include "../headers/gaussian_mixture.h"
+#include "../headers/decision_tree.h"
+#include "../headers/naive_bayes.h"
+using namespace std;
+using namespace Eigen;
+
+struct Config
+{
+	int n = 100000;
+	int d = 20;
+	int k = 5;
+	int knn_queries = 100;
+	int repeats = 3;
+	unsigned seed = 42;
+};
+
+double best_ms(int repeats, function<double()> run)
+{
+	// run returns its own time in ms, e.g. per iteration
+	double best = 1e300;
+	for (int r = 0; r < repeats; r++)
+		best = std::min(best, run());
+	return best;
+}
+
+double elapsed_ms(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+}
+
+template<class F>
+double timed(F f)
+{
+	auto start = chrono::steady_clock::now();
+	f();
+	return elapsed_ms(start);
+}
+
+void print_case(const string& name, double matrix_ms, double dataset_ms, const string& same)
+{
+	cout << setw(24) << name << fixed << setprecision(2) << setw(14) << matrix_ms << setw(14) << dataset_ms <<
+		setw(10) << matrix_ms / dataset_ms << "x" << setw(8) << same << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	Config config;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+		if (key == "--n") config.n = stoi(value);
+		else if (key == "--d") config.d = stoi(value);
+		else if (key == "--k") config.k = stoi(value);
+		else if (key == "--knn-queries") config.knn_queries = stoi(value);
+		else if (key == "--repeats") config.repeats = stoi(value);
+		else if (key == "--seed") config.seed = (unsigned)stoul(value);
+		else {
+			cerr << "Unknown option " << arg << " (see the comment at the top of benchmark/dataset_layout.cpp)" << endl;
+			return 1;
+		}
+	}
+	int n = config.n, d = config.d, k = config.k, repeats = config.repeats;
+
+	MatrixXf X, B;
+	VectorXi Y, Z;
+	SimpleML::make_classification(n, d, std::max(2, k), X, Y, config.seed);
+	SimpleML::make_blobs(n, d, k, B, Z, config.seed, 1.f, 10.f);
+	SimpleML::Dataset X_rows(X), B_rows(B);
+
+	cout << "n = " << n << ", d = " << d << ", k = " << k << ", row stride = " << X_rows.stride() << endl;
+	cout << setw(24) << "case" << setw(14) << "MatrixXf(ms)" << setw(14) << "Dataset(ms)" << setw(11) << "speedup" <<
+		setw(8) << "same" << endl;
+
+	{
+		int queries = std::min(n, config.knn_queries);
+		SimpleML::KNN knn(k);
+		knn.fit(X, Y);
+		SimpleML::Dataset queries_rows(MatrixXf(X.topRows(queries)));
+		VectorXi a, b;
+		double matrix_ms = best_ms(repeats, [&]() { return timed([&]() { a = knn.predict(X.topRows(queries)); }); });
+		double dataset_ms = best_ms(repeats, [&]() { return timed([&]() { b = knn.predict(queries_rows); }); });
+		print_case("knn predict", matrix_ms, dataset_ms, a == b ? "yes" : "NO");
+	}
+	{
+		// the same centers for both, so the assignments must agree
+		SimpleML::KMeans kmeans(k);
+		vector<vector<int>> a, b;
+		double matrix_fit = best_ms(repeats, [&]() {
+			kmeans.fit(B);
+			return kmeans.get_fit_report().fit_ms / kmeans.get_fit_report().n_iter;
+		});
+		double dataset_fit = best_ms(repeats, [&]() {
+			kmeans.fit(B_rows);
+			return kmeans.get_fit_report().fit_ms / kmeans.get_fit_report().n_iter;
+		});
+		print_case("kmeans fit / iter", matrix_fit, dataset_fit, "-");
+		double matrix_ms = best_ms(repeats, [&]() { return timed([&]() { a = kmeans.predict(B); }); });
+		double dataset_ms = best_ms(repeats, [&]() { return timed([&]() { b = kmeans.predict(B_rows); }); });
+		print_case("kmeans predict", matrix_ms, dataset_ms, a == b ? "yes" : "NO");
+	}
+	{
+		SimpleML::GaussianMixture gmm(k);
+		vector<vector<int>> a, b;
+		double matrix_fit = best_ms(repeats, [&]() {
+			gmm.fit(B);
+			return gmm.get_fit_report().fit_ms / gmm.get_fit_report().n_iter;
+		});
+		double dataset_fit = best_ms(repeats, [&]() {
+			gmm.fit(B_rows);
+			return gmm.get_fit_report().fit_ms / gmm.get_fit_report().n_iter;
+		});
+		print_case("gmm fit / iter", matrix_fit, dataset_fit, "-");
+		double matrix_ms = best_ms(repeats, [&]() { return timed([&]() { a = gmm.predict(B); }); });
+		double dataset_ms = best_ms(repeats, [&]() { return timed([&]() { b = gmm.predict(B_rows); }); });
+		print_case("gmm predict", matrix_ms, dataset_ms, a == b ? "yes" : "NO");
+	}
+	for (string covariance : { "full", "diag" }) {
+		SimpleML::NaiveBayes a_nb(covariance), b_nb(covariance);
+		double matrix_fit = best_ms(repeats, [&]() { return timed([&]() { a_nb.fit(X, Y); }); });
+		double dataset_fit = best_ms(repeats, [&]() { return timed([&]() { b_nb.fit(X_rows, Y); }); });
+		VectorXi a, b;
+		double matrix_ms = best_ms(repeats, [&]() { return timed([&]() { a = a_nb.predict(X); }); });
+		double dataset_ms = best_ms(repeats, [&]() { return timed([&]() { b = b_nb.predict(X_rows); }); });
+		print_case("naive_bayes " + covariance + " fit", matrix_fit, dataset_fit, a == b ? "yes" : "NO");
+		print_case("naive_bayes " + covariance + " pred", matrix_ms, dataset_ms, a == b ? "yes" : "NO");
+	}
+	{
+		SimpleML::DecisionTree tree(-1, 2, 0.f);
+		tree.fit(X, Y);
+		VectorXi a, b;
+		double matrix_ms = best_ms(repeats, [&]() { return timed([&]() { a = tree.predict(X); }); });
+		double dataset_ms = best_ms(repeats, [&]() { return timed([&]() { b = tree.predict(X_rows); }); });
+		print_case("tree predict", matrix_ms, dataset_ms, a == b ? "yes" : "NO");
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+	OLS fit time of every solver across n (rows) and p (columns), and of
+	many targets solved against a single factorization.
+
+	g++ benchmark/ols_solvers.cpp --std=c++17 -O2 -pthread -o ols_solvers
+	./ols_solvers
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <Eigen/Dense>
+#include "../headers/ordinary_least_squares.h"
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+	vector<string> solvers = { "auto", "cholesky", "ldlt", "qr", "bdcsvd", "jacobi" };
+	vector<pair<int, int>> shapes = { {1000, 10}, {10000, 10}, {100000, 10}, {10000, 100}, {100000, 50} };
+
+	std::mt19937 gen(42);
+	std::normal_distribution<float> dist(0.f, 1.f);
+
+	cout << setw(8) << "n" << setw(6) << "p";
+	for (const string& solver : solvers)
+		cout << setw(12) << solver;
+	cout << setw(12) << "auto ->" << endl;
+
+	for (const auto& shape : shapes) {
+		int n = shape.first, p = shape.second;
+
+		// y = A * x + noise
+		MatrixXf A = MatrixXf::NullaryExpr(n, p, [&]() { return dist(gen); });
+		VectorXf x = VectorXf::NullaryExpr(p, [&]() { return dist(gen); });
+		VectorXf b = A * x + 0.1f * VectorXf::NullaryExpr(n, [&]() { return dist(gen); });
+
+		cout << setw(8) << n << setw(6) << p;
+		string picked;
+		for (const string& solver : solvers) {
+			// the Jacobi SVD is too slow to finish on the large shapes
+			if (solver == "jacobi" && (long long)n * p * p > 100000000LL) {
+				cout << setw(12) << "-";
+				continue;
+			}
+			SimpleML::OLS ols(solver);
+			auto start = chrono::steady_clock::now();
+			ols.fit(A, b);
+			auto end = chrono::steady_clock::now();
+			cout << setw(10) << fixed << setprecision(2) <<
+				chrono::duration<double, std::milli>(end - start).count() << "ms";
+			if (solver == "auto")
+				picked = ols.get_fitted_solver();
+		}
+		cout << setw(12) << picked << endl;
+	}
+
+	// many targets against one design matrix: refit per target vs one factorization
+	int n = 100000, p = 20, n_target = 200;
+	MatrixXf A = MatrixXf::NullaryExpr(n, p, [&]() { return dist(gen); });
+	MatrixXf B = A * MatrixXf::NullaryExpr(p, n_target, [&]() { return dist(gen); });
+
+	SimpleML::OLS ols("qr");
+	auto start = chrono::steady_clock::now();
+	for (int j = 0; j < n_target; j++)
+		ols.fit(A, B.col(j));
+	auto mid = chrono::steady_clock::now();
+	ols.fit(A, B);
+	auto end = chrono::steady_clock::now();
+
+	cout << endl << n_target << " targets, n = " << n << ", p = " << p << " (qr)" << endl;
+	cout << "one fit per target : " << chrono::duration<double, std::milli>(mid - start).count() << "ms" << endl;
+	cout << "multi-target fit   : " << chrono::duration<double, std::milli>(end - mid).count() << "ms" << endl;
+	return 0;
+}
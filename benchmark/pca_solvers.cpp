@@ -0,0 +1,68 @@
+/*
+	PCA fit time of the full SVD, randomized SVD and covariance eigendecomposition
+	solvers, and the relative error of their explained variances against the full SVD.
+
+	g++ benchmark/pca_solvers.cpp --std=c++17 -O2 -pthread -o pca_solvers
+	./pca_solvers
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <Eigen/Dense>
+#include "../headers/principal_component_analysis.h"
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+	struct Shape { int n, d, k; };
+	vector<Shape> shapes = { {1000, 200, 10}, {2000, 500, 10}, {5000, 500, 20}, {5000, 1000, 20}, {20000, 50, 10} };
+
+	std::mt19937 gen(42);
+	std::normal_distribution<float> dist(0.f, 1.f);
+
+	cout << setw(8) << "n" << setw(6) << "d" << setw(6) << "k" << setw(14) << "full" <<
+		setw(14) << "randomized" << setw(14) << "rel err" << setw(14) << "covariance" << setw(14) << "rel err" << endl;
+
+	for (const Shape& shape : shapes) {
+		// rank-50 signal with a decaying spectrum plus isotropic noise
+		int rank = 50;
+		MatrixXf left = MatrixXf::NullaryExpr(shape.n, rank, [&]() { return dist(gen); });
+		MatrixXf right = MatrixXf::NullaryExpr(rank, shape.d, [&]() { return dist(gen); });
+		VectorXf decay(rank);
+		for (int i = 0; i < rank; i++)
+			decay[i] = std::pow(0.9f, (float)i);
+		MatrixXf X = left * decay.asDiagonal() * right +
+			0.1f * MatrixXf::NullaryExpr(shape.n, shape.d, [&]() { return dist(gen); });
+
+		SimpleML::PCA full(shape.k, "full");
+		auto start = chrono::steady_clock::now();
+		full.fit(X);
+		auto mid = chrono::steady_clock::now();
+
+		SimpleML::PCA randomized(shape.k, "randomized", 10, 4, false, 42);
+		randomized.fit(X);
+		auto end = chrono::steady_clock::now();
+
+		SimpleML::PCA covariance(shape.k, "covariance");
+		covariance.fit(X, 0);
+		auto last = chrono::steady_clock::now();
+
+		// maximum relative error of the explained variances
+		auto error = [&](const SimpleML::PCA& pca) {
+			ArrayXf expected = full.explained_variance.array();
+			return ((pca.explained_variance.array() - expected).abs() / expected).maxCoeff();
+		};
+
+		cout << setw(8) << shape.n << setw(6) << shape.d << setw(6) << shape.k <<
+			setw(12) << fixed << setprecision(1) << chrono::duration<double, std::milli>(mid - start).count() << "ms" <<
+			setw(12) << chrono::duration<double, std::milli>(end - mid).count() << "ms" <<
+			setw(14) << scientific << setprecision(2) << error(randomized) <<
+			setw(12) << fixed << setprecision(1) << chrono::duration<double, std::milli>(last - end).count() << "ms" <<
+			setw(14) << scientific << setprecision(2) << error(covariance) << endl;
+	}
+	return 0;
+}
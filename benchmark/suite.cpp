@@ -0,0 +1,293 @@
+/*
+	Fit and predict time, rows/sec and peak RSS of every model on synthetic data
+	of a chosen size, across thread counts for the models that take n_jobs.
+	Results are printed as a table and written as JSON for regression tracking.
+
+	g++ benchmark/suite.cpp --std=c++17 -O2 -pthread -o suite
+	./suite --n=1000000 --d=50 --k=5 --threads=1,2,4,8 --json=suite.json
+	./suite --models=kmeans,pca --n=100000
+
+	Options (defaults in brackets)
+		--n            rows [100000]
+		--d            features [20]
+		--k            clusters / classes / components [5]
+		--threads      comma separated thread counts [1,<all cores>]
+		--models       comma separated subset of
+		               knn,kmeans,gmm,tree,naive_bayes,ols,incremental_ols,pca [all]
+		--knn-queries  rows predicted by KNN, whose predict is O(n) per row [1000]
+		--seed         generator seed [42]
+		--json         output file [suite.json]
+
+	Every case runs in a forked child process (POSIX only), so the peak RSS of
+	one case is not inflated by the cases before it. It includes the dataset.
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <Eigen/Dense>
+#include "../headers/synthetic_data.h"
+#include "../headers/k_nearest_neighbors.h"
+#include "../headers/k_means.h"
+#include "../headers/gaussian_mixture.h"
+#include "../headers/decision_tree.h"
+#include "../headers/naive_bayes.h"
+#include "../headers/ordinary_least_squares.h"
+#include "../headers/principal_component_analysis.h"
+using namespace std;
+using namespace Eigen;
+
+struct Config
+{
+	int n = 100000;
+	int d = 20;
+	int k = 5;
+	vector<int> threads;
+	vector<string> models = { "knn", "kmeans", "gmm", "tree", "naive_bayes", "ols", "incremental_ols", "pca" };
+	int knn_queries = 1000;
+	unsigned seed = 42;
+	string json = "suite.json";
+};
+
+struct Measurement
+{
+	double fit_ms = 0;
+	double predict_ms = 0;
+	long long predict_rows = 0;
+};
+
+vector<string> split(const string& text, char delimiter)
+{
+	vector<string> tokens;
+	stringstream ss(text);
+	string token;
+	while (getline(ss, token, delimiter)) {
+		if (!token.empty())
+			tokens.push_back(token);
+	}
+	return tokens;
+}
+
+double elapsed_ms(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+}
+
+bool takes_n_jobs(const string& model)
+{
+	return model != "ols";
+}
+
+Measurement run_model(const Config& config, const string& model, int n_jobs)
+{
+	Measurement m;
+	int n = config.n, d = config.d, k = config.k;
+	MatrixXf X;
+	VectorXi Y;
+	VectorXf y, coeffs;
+	if (model == "kmeans" || model == "gmm" || model == "pca")
+		SimpleML::make_blobs(n, d, k, X, Y, config.seed, 1.f, 10.f, 0);
+	else if (model == "ols" || model == "incremental_ols")
+		SimpleML::make_regression(n, d, X, y, coeffs, config.seed, 0.1f, 0);
+	else
+		SimpleML::make_classification(n, d, std::max(2, k), X, Y, config.seed, 0);
+
+	auto start = chrono::steady_clock::now();
+	if (model == "knn") {
+		SimpleML::KNN knn(k);
+		knn.fit(X, Y);
+		m.fit_ms = elapsed_ms(start);
+		int queries = std::min(n, config.knn_queries);
+		start = chrono::steady_clock::now();
+		knn.predict(X.topRows(queries), n_jobs);
+		m.predict_ms = elapsed_ms(start);
+		m.predict_rows = queries;
+		return m;
+	}
+	m.predict_rows = n;
+	if (model == "kmeans") {
+		SimpleML::KMeans kmeans(k);
+		kmeans.fit(X, n_jobs);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		kmeans.predict(X, n_jobs);
+	}
+	else if (model == "gmm") {
+		SimpleML::GaussianMixture gmm(k);
+		gmm.fit(X, n_jobs);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		gmm.predict(X, n_jobs);
+	}
+	else if (model == "tree") {
+		SimpleML::DecisionTree tree(-1, 2, 0.f);
+		tree.fit(X, Y, n_jobs);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		tree.predict(X, n_jobs);
+	}
+	else if (model == "naive_bayes") {
+		SimpleML::NaiveBayes nb;
+		nb.fit(X, Y, n_jobs);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		nb.predict(X, n_jobs);
+	}
+	else if (model == "ols") {
+		SimpleML::OLS ols;
+		ols.fit(X, y);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		ols.predict(X);
+	}
+	else if (model == "incremental_ols") {
+		SimpleML::IncrementalOLS ols(true);
+		ols.fit(X, y, n_jobs);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		ols.predict(X);
+	}
+	else if (model == "pca") {
+		SimpleML::PCA pca(std::min(k, d));
+		pca.fit(X, n_jobs);
+		m.fit_ms = elapsed_ms(start);
+		start = chrono::steady_clock::now();
+		pca.transform(X);
+	}
+	m.predict_ms = elapsed_ms(start);
+	return m;
+}
+
+string run_case(const Config& config, const string& model, int n_jobs)
+{
+	/*
+		forks, runs one case in the child and returns its JSON record. The
+		parent never touches the thread pool, so the child starts single threaded.
+	*/
+	int fds[2];
+	if (pipe(fds) != 0) {
+		cerr << "Error(run_case): pipe failed." << endl;
+		exit(1);
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		Measurement m = run_model(config, model, n_jobs);
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+
+		double seconds_fit = std::max(m.fit_ms, 1e-6) / 1000.;
+		double seconds_predict = std::max(m.predict_ms, 1e-6) / 1000.;
+		stringstream record;
+		record << fixed << setprecision(3) <<
+			"{\"model\": \"" << model << "\", \"n\": " << config.n << ", \"d\": " << config.d <<
+			", \"k\": " << config.k << ", \"threads\": " << n_jobs <<
+			", \"fit_ms\": " << m.fit_ms << ", \"predict_ms\": " << m.predict_ms <<
+			", \"predict_rows\": " << m.predict_rows <<
+			", \"fit_rows_per_sec\": " << config.n / seconds_fit <<
+			", \"predict_rows_per_sec\": " << m.predict_rows / seconds_predict <<
+			", \"peak_rss_kb\": " << usage.ru_maxrss << "}";
+		string text = record.str();
+		ssize_t written = write(fds[1], text.data(), text.size());
+		close(fds[1]);
+		cout.flush();
+		_exit(written == (ssize_t)text.size() ? 0 : 1);
+	}
+
+	close(fds[1]);
+	string text;
+	char buffer[4096];
+	ssize_t count;
+	while ((count = read(fds[0], buffer, sizeof(buffer))) > 0)
+		text.append(buffer, count);
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || text.empty()) {
+		cerr << "Error(run_case): " << model << " with " << n_jobs << " threads failed." << endl;
+		return "";
+	}
+	return text;
+}
+
+string field(const string& record, const string& key)
+{
+	// the value of "key" in a flat record written by run_case
+	size_t pos = record.find("\"" + key + "\": ");
+	if (pos == string::npos)
+		return "";
+	pos += key.size() + 4;
+	size_t end = record.find_first_of(",}", pos);
+	string value = record.substr(pos, end - pos);
+	if (!value.empty() && value.front() == '"')
+		value = value.substr(1, value.size() - 2);
+	return value;
+}
+
+int main(int argc, char* argv[])
+{
+	Config config;
+	config.threads = { 1, std::max(1, (int)std::thread::hardware_concurrency()) };
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+		if (key == "--n") config.n = stoi(value);
+		else if (key == "--d") config.d = stoi(value);
+		else if (key == "--k") config.k = stoi(value);
+		else if (key == "--knn-queries") config.knn_queries = stoi(value);
+		else if (key == "--seed") config.seed = (unsigned)stoul(value);
+		else if (key == "--json") config.json = value;
+		else if (key == "--models") config.models = split(value, ',');
+		else if (key == "--threads") {
+			config.threads.clear();
+			for (const string& token : split(value, ','))
+				config.threads.push_back(stoi(token));
+		}
+		else {
+			cerr << "Unknown option " << arg << " (see the comment at the top of benchmark/suite.cpp)" << endl;
+			return 1;
+		}
+	}
+	std::sort(config.threads.begin(), config.threads.end());
+	config.threads.erase(std::unique(config.threads.begin(), config.threads.end()), config.threads.end());
+
+	cout << "n = " << config.n << ", d = " << config.d << ", k = " << config.k << endl;
+	cout << setw(16) << "model" << setw(8) << "threads" << setw(12) << "fit(ms)" << setw(14) << "fit rows/s" <<
+		setw(12) << "pred(ms)" << setw(14) << "pred rows/s" << setw(12) << "rss(MB)" << endl;
+
+	vector<string> records;
+	for (const string& model : config.models) {
+		// models without n_jobs only run once; more threads would measure the same thing
+		vector<int> threads = takes_n_jobs(model) ? config.threads : vector<int>{ 1 };
+		for (int n_jobs : threads) {
+			string record = run_case(config, model, n_jobs);
+			if (record.empty())
+				continue;
+			records.push_back(record);
+			cout << setw(16) << model << setw(8) << n_jobs << fixed << setprecision(1) <<
+				setw(12) << stod(field(record, "fit_ms")) << setw(14) << setprecision(0) << stod(field(record, "fit_rows_per_sec")) <<
+				setw(12) << setprecision(1) << stod(field(record, "predict_ms")) <<
+				setw(14) << setprecision(0) << stod(field(record, "predict_rows_per_sec")) <<
+				setw(12) << setprecision(1) << stod(field(record, "peak_rss_kb")) / 1024. << endl;
+		}
+	}
+
+	ofstream out(config.json);
+	out << "{\n  \"suite\": \"simpleml\",\n  \"hardware_concurrency\": " << std::thread::hardware_concurrency() <<
+		",\n  \"seed\": " << config.seed << ",\n  \"results\": [\n";
+	for (int i = 0; i < (int)records.size(); i++)
+		out << "    " << records[i] << (i + 1 < (int)records.size() ? ",\n" : "\n");
+	out << "  ]\n}\n";
+	cout << "results written to " << config.json << endl;
+	return 0;
+}
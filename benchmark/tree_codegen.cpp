@@ -0,0 +1,84 @@
+/*
+	Per-row latency of a generated tree function vs DecisionTree::predict.
+
+	1) export the tree (run from the project directory)
+		g++ benchmark/tree_codegen.cpp --std=c++17 -O2 -o tree_codegen
+		./tree_codegen
+	2) compile the generated code in and benchmark
+		g++ benchmark/tree_codegen.cpp --std=c++17 -O2 -DGENERATED_TREE -o tree_codegen
+		./tree_codegen
+
+	Tree training is deterministic, so both runs fit the same tree.
+*/
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <Eigen/Dense>
+#include "../headers/file_manage.h"
+#include "../headers/model_evaluation.h"
+#include "../headers/decision_tree.h"
+#ifdef GENERATED_TREE
+#include "generated_tree_branch.h"
+#include "generated_tree_table.h"
+#endif
+using namespace std;
+using namespace Eigen;
+
+template<class F>
+double ns_per_row(F f, int n_row, int repeat)
+{
+	auto start = chrono::steady_clock::now();
+	for (int r = 0; r < repeat; r++)
+		f();
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double, std::nano>(end - start).count() / ((double)n_row * repeat);
+}
+
+int main()
+{
+	string file_name = "./dataset/winequality-white.csv";
+
+	MatrixXf X;
+	VectorXi Y;
+
+	// read csv
+	SimpleML::read_csv(file_name, X, Y);
+
+	// a deep tree, so that traversal dominates
+	SimpleML::DecisionTree dt(-1, 2, 0.f);
+	dt.fit(X, Y);
+
+#ifndef GENERATED_TREE
+	dt.export_cpp("./benchmark/generated_tree_branch.h", "predict_branch", "branch");
+	dt.export_cpp("./benchmark/generated_tree_table.h", "predict_table", "table");
+	cout << "Exported. Recompile with -DGENERATED_TREE to benchmark." << endl;
+#else
+	// generated functions take a pointer to a contiguous row
+	Matrix<float, Dynamic, Dynamic, RowMajor> R = X;
+	int N = (int)X.rows();
+	int repeat = 100;
+
+	VectorXi expected = dt.predict(X);
+	VectorXi branch(N), table(N);
+	for (int i = 0; i < N; i++) {
+		branch[i] = predict_branch(R.row(i).data());
+		table[i] = predict_table(R.row(i).data());
+	}
+	cout << "Agreement(branch): " << SimpleML::calc_accuracy(expected, branch) * 100 << "%" << endl;
+	cout << "Agreement(table) : " << SimpleML::calc_accuracy(expected, table) * 100 << "%" << endl;
+
+	volatile int sink = 0;
+	double t_predict = ns_per_row([&]() { sink += dt.predict(X)[0]; }, N, repeat);
+	double t_branch = ns_per_row([&]() {
+		for (int i = 0; i < N; i++) sink += predict_branch(R.row(i).data());
+	}, N, repeat);
+	double t_table = ns_per_row([&]() {
+		for (int i = 0; i < N; i++) sink += predict_table(R.row(i).data());
+	}, N, repeat);
+
+	cout << "DecisionTree::predict : " << t_predict << " ns/row" << endl;
+	cout << "generated (branch)    : " << t_branch << " ns/row" << endl;
+	cout << "generated (table)     : " << t_table << " ns/row" << endl;
+#endif
+	return 0;
+}
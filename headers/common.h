@@ -3,14 +3,77 @@
 #include <vector>
 #include <random>
 #include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <type_traits>
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "parallel.h"
 using namespace std;
 using namespace Eigen;
 
+/*
+	Feature counts with compiled-in kernels (fixed-size Eigen types, unrolled
+	and allocation free); any other count runs the same kernels with Dynamic.
+	Override with e.g. -DSIMPLEML_FIXED_DIMENSIONS=4,11 (sizes >= 2), or define
+	it empty to build the dynamic kernels only.
+*/
+#ifndef SIMPLEML_FIXED_DIMENSIONS
+#define SIMPLEML_FIXED_DIMENSIONS 2, 3, 4, 8, 11
+#endif
+
 namespace SimpleML
 {
-	float euclidean_norm(const RowVectorXf& p1, const RowVectorXf& p2) {
-		return std::sqrt((p1 - p2).array().pow(2.f).sum());
+	// Eigen types of a given Scalar; the models are templates on it (float, double, ...)
+	template<class Scalar>
+	using MatrixT = Matrix<Scalar, Dynamic, Dynamic>;
+
+	template<class Scalar>
+	using RowVectorT = Matrix<Scalar, 1, Dynamic>;
+
+	template<class Scalar>
+	using VectorT = Matrix<Scalar, Dynamic, 1>;
+
+	// row-major storage, so that a row is one contiguous D-vector
+	template<class Scalar>
+	using RowMatrixT = Matrix<Scalar, Dynamic, Dynamic, RowMajor>;
+
+	// compressed rows (CSR), e.g. the features of read_libsvm
+	template<class Scalar>
+	using SparseRowMatrixT = SparseMatrix<Scalar, RowMajor>;
+
+	template<int... Ds>
+	struct DimensionList {};
+
+	template<class F>
+	void dispatch_dimension(int /*d*/, F& f, DimensionList<>)
+	{
+		f(std::integral_constant<int, Dynamic>());
+	}
+
+	template<class F, int D, int... Ds>
+	void dispatch_dimension(int d, F& f, DimensionList<D, Ds...>)
+	{
+		if (d == D)
+			f(std::integral_constant<int, D>());
+		else
+			dispatch_dimension(d, f, DimensionList<Ds...>());
+	}
+
+	template<class F>
+	void dispatch_dimension(int d, F f)
+	{
+		/*
+			calls f(std::integral_constant<int, D>()) with D == d if d is one of
+			SIMPLEML_FIXED_DIMENSIONS, with D == Dynamic otherwise. f is usually a
+			generic lambda: [&](auto dim) { constexpr int D = decltype(dim)::value; ... }
+		*/
+		dispatch_dimension(d, f, DimensionList<SIMPLEML_FIXED_DIMENSIONS>());
+	}
+
+	template<class Derived1, class Derived2>
+	typename Derived1::Scalar euclidean_norm(const MatrixBase<Derived1>& p1, const MatrixBase<Derived2>& p2) {
+		return std::sqrt((p1 - p2).array().square().sum());
 	}
 	
 	vector<int> generate_random_index(int size)
@@ -22,32 +85,116 @@ namespace SimpleML
 		return rand_num;
 	}
 
-	MatrixXf covariance_matrix(const MatrixXf& X)
+	template<class Derived>
+	MatrixXd covariance_matrix_double(const MatrixBase<Derived>& X, int n_jobs = 1)
 	{
-		MatrixXf centered = X.rowwise() - X.colwise().mean();
-		return centered.transpose() * centered / (float)(X.rows() - 1);
+		/*
+			centered rows are widened to double a block at a time and folded into
+			the lower triangle of a per-job d x d accumulator, so X is never copied
+			as a whole. Jobs take contiguous row ranges and are summed in order.
+		*/
+		int d = (int)X.cols();
+		RowVectorXd mean = X.template cast<double>().colwise().mean();
+
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), (int)X.rows()));
+		vector<MatrixXd> partial(n_jobs);
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int job) {
+			const int block_size = 1024;
+			MatrixXd& scatter = partial[job];
+			scatter = MatrixXd::Zero(d, d);
+			for (int first = begin; first < end; first += block_size) {
+				int rows = std::min(block_size, end - first);
+				MatrixXd block = X.middleRows(first, rows).template cast<double>().rowwise() - mean;
+				scatter.selfadjointView<Lower>().rankUpdate(block.transpose());
+			}
+		});
+
+		MatrixXd scatter = partial[0];
+		for (int job = 1; job < n_jobs; job++)
+			scatter += partial[job];
+
+		MatrixXd cov = scatter.selfadjointView<Lower>();
+		return cov / (double)std::max((int)X.rows() - 1, 1);
 	}
 
-	float multivariate_normal(const RowVectorXf& x, const RowVectorXf& mu, const MatrixXf& sigma)
+	template<class Derived>
+	MatrixT<typename Derived::Scalar> covariance_matrix(const MatrixBase<Derived>& X, int n_jobs = 1)
 	{
-		float inv_sqrt_2pi = 0.3989422804014327f;
-		float quad = (x - mu) * sigma.inverse() * (x - mu).transpose();
-		float norm = pow(inv_sqrt_2pi, (float)sigma.rows()) * pow(sigma.determinant(), -.5f);
-		return norm * exp(-.5f * quad);
+		// in the type of X, e.g. float; covariance_matrix_double keeps the double accumulation
+		return covariance_matrix_double(X, n_jobs).template cast<typename Derived::Scalar>();
 	}
 
-	float multivariate_log_likelihood(const MatrixXf& X, const RowVectorXf& phi,
-		const RowVectorXf* mu, const MatrixXf* sigma, int K)
+	template<class Derived, class Scalar>
+	Scalar multivariate_normal(const MatrixBase<Derived>& x, const RowVectorT<Scalar>& mu, const MatrixT<Scalar>& sigma)
 	{
-		float log_lkhd = 0.f;
-		for (int i = 0; i < X.rows(); i++) {
-			float lkhd = 0.f;
-			for (int j = 0; j < K; j++) {
-				lkhd += phi[j] * multivariate_normal(X.row(i), mu[j], sigma[j]);
-			}
-			log_lkhd += std::log(lkhd);
+		Scalar inv_sqrt_2pi = (Scalar)0.3989422804014327;
+		Scalar quad = (x - mu) * sigma.inverse() * (x - mu).transpose();
+		Scalar norm = pow(inv_sqrt_2pi, (Scalar)sigma.rows()) * pow(sigma.determinant(), (Scalar)-.5);
+		return norm * exp((Scalar)-.5 * quad);
+	}
+
+	template<class Scalar, int D>
+	class GaussianDensity
+	{
+		// N(x | mu, sigma) with sigma inverted once, not at every evaluation
+	private:
+		Matrix<Scalar, 1, D> mu;
+		Matrix<Scalar, D, D> precision;
+		Scalar norm;
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		GaussianDensity(const RowVectorT<Scalar>& mu, const MatrixT<Scalar>& sigma) : mu(mu)
+		{
+			Matrix<Scalar, D, D> fixed = sigma;
+			Scalar inv_sqrt_2pi = (Scalar)0.3989422804014327;
+			precision = fixed.inverse();
+			norm = pow(inv_sqrt_2pi, (Scalar)sigma.rows()) * pow(fixed.determinant(), (Scalar)-.5);
 		}
-		return log_lkhd;
+
+		template<class Derived>
+		Scalar operator()(const MatrixBase<Derived>& x) const
+		{
+			Matrix<Scalar, 1, D> centered = x - mu;
+			Scalar quad = (centered * precision).dot(centered);
+			return norm * exp((Scalar)-.5 * quad);
+		}
+	};
+
+	template<class Scalar, int D>
+	using GaussianDensities = vector<GaussianDensity<Scalar, D>, aligned_allocator<GaussianDensity<Scalar, D>>>;
+
+	template<int D, class Scalar>
+	GaussianDensities<Scalar, D> gaussian_densities(const RowVectorT<Scalar>* mu, const MatrixT<Scalar>* sigma, int K)
+	{
+		GaussianDensities<Scalar, D> densities;
+		densities.reserve(K);
+		for (int j = 0; j < K; j++)
+			densities.emplace_back(mu[j], sigma[j]);
+		return densities;
+	}
+
+	template<class Scalar, class Accumulator = Scalar, class Derived>
+	Accumulator multivariate_log_likelihood(const MatrixBase<Derived>& X, const RowVectorT<Scalar>& phi,
+		const RowVectorT<Scalar>* mu, const MatrixT<Scalar>* sigma, int K, int n_jobs = 1)
+	{
+		// densities in Scalar, the mixture and the log sum in Accumulator
+		Accumulator result = 0;
+		dispatch_dimension((int)X.cols(), [&](auto dim) {
+			constexpr int D = decltype(dim)::value;
+			GaussianDensities<Scalar, D> density = gaussian_densities<D>(mu, sigma, K);
+			result = parallel_reduce(0, (int)X.rows(), n_jobs, (Accumulator)0, [&](int begin, int end) {
+				Accumulator log_lkhd = 0;
+				for (int i = begin; i < end; i++) {
+					Accumulator lkhd = 0;
+					for (int j = 0; j < K; j++) {
+						lkhd += (Accumulator)phi[j] * density[j](X.row(i));
+					}
+					log_lkhd += std::log(lkhd);
+				}
+				return log_lkhd;
+			}, [](Accumulator a, Accumulator b) { return a + b; });
+		});
+		return result;
 	}
 
 	MatrixXf add_constant(const MatrixXf& X)
@@ -0,0 +1,165 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "common.h"
+#include "serialization.h"
+using namespace std;
+using namespace Eigen;
+
+/*
+	Every Dataset row is padded to a multiple of this many bytes, so that rows
+	start on a SIMD packet boundary; the buffer itself starts on a 64-byte
+	(cache line) boundary. Larger values trade memory for alignment.
+*/
+#ifndef SIMPLEML_ROW_ALIGNMENT
+#define SIMPLEML_ROW_ALIGNMENT 16
+#endif
+
+namespace SimpleML
+{
+	// the rows of a Dataset as an Eigen expression, the padding is skipped by the outer stride
+	template<class Scalar>
+	using DatasetView = Map<const RowMatrixT<Scalar>, Aligned16, OuterStride<>>;
+
+	template<class Scalar>
+	class BasicDataset
+	{
+		/*
+			Samples stored row-major, for the row-at-a-time loops of the models
+			(distances, densities, per-row statistics, tree traversal): a row is
+			contiguous instead of strided across the columns of a MatrixXf. The
+			padding is zero. The buffer is immutable and shared by copies; it is
+			owned, or the mapped file of load().
+		*/
+	private:
+		Index n_rows;
+		Index n_cols;
+		Index row_stride;
+		shared_ptr<Scalar> buffer;
+		shared_ptr<MappedFile> mapping;
+		const Scalar* base;
+	public:
+		BasicDataset();
+		explicit BasicDataset(const MatrixT<Scalar>& X);
+		BasicDataset(const Scalar* data, Index rows, Index cols);
+		Index rows() const;
+		Index cols() const;
+		Index stride() const;
+		const Scalar* data() const;
+		DatasetView<Scalar> view() const;
+		MatrixT<Scalar> to_matrix() const;
+		void save(const string& path) const;
+		void load(const string& path);
+	private:
+		Scalar* allocate(Index rows, Index cols);
+	};
+
+	typedef BasicDataset<float> Dataset;
+	typedef BasicDataset<double> Datasetd;
+
+	/*---------------------------------------------------------------------------------------*/
+
+	template<class Scalar>
+	BasicDataset<Scalar>::BasicDataset() : n_rows(0), n_cols(0), row_stride(0), base(nullptr) {}
+
+	template<class Scalar>
+	BasicDataset<Scalar>::BasicDataset(const MatrixT<Scalar>& X)
+	{
+		// e.g. the features of read_csv
+		Scalar* rows = allocate(X.rows(), X.cols());
+		Map<RowMatrixT<Scalar>, Aligned16, OuterStride<>> target(rows, n_rows, n_cols, OuterStride<>(row_stride));
+		target = X;
+	}
+
+	template<class Scalar>
+	BasicDataset<Scalar>::BasicDataset(const Scalar* data, Index rows, Index cols)
+	{
+		// unpadded row-major rows, e.g. a binary file mapped by the caller
+		Scalar* target = allocate(rows, cols);
+		for (Index i = 0; i < rows; i++)
+			std::copy(data + i * cols, data + (i + 1) * cols, target + i * row_stride);
+	}
+
+	template<class Scalar>
+	Scalar* BasicDataset<Scalar>::allocate(Index rows, Index cols)
+	{
+		// zeroed, so that the padding is zero
+		const Index per_packet = std::max<Index>(1, SIMPLEML_ROW_ALIGNMENT / (Index)sizeof(Scalar));
+		n_rows = rows;
+		n_cols = cols;
+		row_stride = (cols + per_packet - 1) / per_packet * per_packet;
+		size_t bytes = std::max<size_t>((size_t)(rows * row_stride) * sizeof(Scalar), 1);
+		bytes = (bytes + 63) / 64 * 64;
+		void* memory = std::aligned_alloc(64, bytes);
+		if (memory == nullptr) {
+			cout << "Error(BasicDataset::allocate(Index, Index)): Out of memory." << endl;
+			exit(1);
+		}
+		std::fill((char*)memory, (char*)memory + bytes, 0);
+		buffer.reset((Scalar*)memory, [](Scalar* p) { std::free(p); });
+		mapping.reset();
+		base = (Scalar*)memory;
+		return (Scalar*)memory;
+	}
+
+	template<class Scalar>
+	Index BasicDataset<Scalar>::rows() const { return n_rows; }
+
+	template<class Scalar>
+	Index BasicDataset<Scalar>::cols() const { return n_cols; }
+
+	template<class Scalar>
+	Index BasicDataset<Scalar>::stride() const { return row_stride; }
+
+	template<class Scalar>
+	const Scalar* BasicDataset<Scalar>::data() const { return base; }
+
+	template<class Scalar>
+	DatasetView<Scalar> BasicDataset<Scalar>::view() const
+	{
+		return DatasetView<Scalar>(base, n_rows, n_cols, OuterStride<>(std::max<Index>(row_stride, 1)));
+	}
+
+	template<class Scalar>
+	MatrixT<Scalar> BasicDataset<Scalar>::to_matrix() const { return view(); }
+
+	template<class Scalar>
+	void BasicDataset<Scalar>::save(const string& path) const
+	{
+		// the padded rows as they are, so that load can map them in place
+		ModelWriter writer(path, "Dataset", 1);
+		writer.write_int(n_cols);
+		writer.write_array(base, n_rows, row_stride, true);
+		writer.close();
+	}
+
+	template<class Scalar>
+	void BasicDataset<Scalar>::load(const string& path)
+	{
+		// the rows stay in the mapped file unless they have to be converted
+		ModelReader reader(path, "Dataset", 1);
+		Index cols = (Index)reader.read_int();
+		Index rows, stride;
+		const Scalar* data = reader.read_array<Scalar>(rows, stride, true);
+		if (cols < 0 || stride < cols) {
+			cout << "Error(BasicDataset::load(const string&)): Corrupt dataset file." << endl;
+			exit(1);
+		}
+		if ((uintptr_t)data % 64 != 0) {
+			*this = BasicDataset(Map<const RowMatrixT<Scalar>, Unaligned, OuterStride<>>(data, rows, cols,
+				OuterStride<>(std::max<Index>(stride, 1))));
+			return;
+		}
+		buffer.reset();
+		mapping = reader.mapping();
+		base = data;
+		n_rows = rows;
+		n_cols = cols;
+		row_stride = stride;
+	}
+}
@@ -1,10 +1,18 @@
 #pragma once
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <string>
 #include <vector>
+#include <memory>
+#include <chrono>
 #include <numeric>
 #include <algorithm>
 #include <Eigen/Dense>
+#include "dataset.h"
+#include "instrumentation.h"
+#include "parallel.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
@@ -17,8 +25,9 @@ namespace SimpleML
 		float gain;
 		Question() : col(0), value(0), gain(0) {}
 		Question(int col, float value) : col(col), value(value), gain(0) {}
-		bool match(const RowVectorXf& x) const { return x[col] >= value; }
-		Question& operator=(const Question& other) 
+		template<class T>
+		bool match(const T& x) const { return x[col] >= value; }
+		Question& operator=(const Question& other)
 		{
 			col = other.col;
 			value = other.value;
@@ -32,12 +41,21 @@ namespace SimpleML
 		Question Q;
 		Node* left = nullptr;
 		Node* right = nullptr;
-		vector<int> labels;
-		~Node()
-		{
-			delete left;
-			delete right;
-		}
+		int* labels = nullptr;		// class counts (n_class entries), owned by the arena
+	};
+
+	class Arena
+	{
+	private:
+		vector<unique_ptr<char[]>> blocks;
+		size_t block_size;
+		size_t used;
+	public:
+		Arena(size_t block_size = 1 << 16);
+		template<class T>
+		T* allocate(size_t n = 1);
+		void clear();
+		int block_count() const;
 	};
 
 	class DecisionTree
@@ -45,190 +63,394 @@ namespace SimpleML
 	private:
 		Node* root;
 		int n_class;
+		int max_depth;
+		int min_samples_split;
+		float min_impurity_decrease;
+		int n_jobs;
+		Arena arena;
+		vector<int> cols;
+		vector<int> left_counts;
+		vector<int> right_counts;
+		FitReport report;
+		// pre-order nodes for predict: col, left, right, label per node (left == -1 for a leaf)
+		// and the thresholds, in node_links/node_values or in the mapped file of load()
+		int n_node;
+		vector<int> node_links;
+		vector<float> node_values;
+		const int* links;
+		const float* values;
+		shared_ptr<MappedFile> mapping;
 	public:
-		DecisionTree();
-		~DecisionTree();
-		void fit(const MatrixXf& X, const VectorXi& Y);
-		VectorXi predict(const MatrixXf& X);
+		DecisionTree(int max_depth = -1, int min_samples_split = 2, float min_impurity_decrease = 0.2f);
+		DecisionTree(const DecisionTree& other);
+		DecisionTree& operator=(const DecisionTree& other);
+		void fit(const MatrixXf& X, const VectorXi& Y, int n_jobs = 1);
+		void fit(const Dataset& X, const VectorXi& Y, int n_jobs = 1);
+		VectorXi predict(const MatrixXf& X, int n_jobs = 1);
+		VectorXi predict(const Dataset& X, int n_jobs = 1);
 		void print_tree();
+		void export_cpp(string file_name, string function_name = "predict_tree", string style = "branch");
+		const FitReport& get_fit_report() const;
+		void save(const string& path) const;
+		void load(const string& path);
+	private:
+		Node* build_tree(const MatrixXf& X, const VectorXi& Y, int* first, int* last, int n_cols, int depth);
+		Question find_best_question(const MatrixXf& X, const VectorXi& Y,
+			int* first, int* last, const int* counts, int n_cols);
+		Question find_best_question_in_columns(const MatrixXf& X, const VectorXi& Y, int* first, int* last,
+			const int* counts, int col_begin, int col_end, int* left, int* right, float current_impurity);
+		Node* clone_node(const Node* node);
+		void flatten_tree();
+		int flatten(const Node* node);
+		Node* rebuild_node(int idx, const int* counts);
+		template<class Derived>
+		VectorXi predict_data(const MatrixBase<Derived>& X, int n_jobs);
 	};
 
-	void build_tree(Node*& node, const MatrixXf& X, const VectorXi& Y,
-		const vector<int>& split, const vector<int>& cols);
+	float gini(const int* counts, int n_class, int size);
 
-	Question find_best_question(const MatrixXf& X, const VectorXi& Y,
-		const vector<int>& split, const vector<int>& cols);
+	float entropy(const int* counts, int n_class, int size);
 
-	float gini(const VectorXi& Y, const vector<int>& split);
+	void count_class(const VectorXi& Y, const int* first, const int* last, int* counts, int n_class);
 
-	float entropy(const VectorXi& Y, const vector<int>& split);
+	int* partition_node(const Question& Q, const MatrixXf& X, int* first, int* last);
 
-	vector<int> count_class(const VectorXi& Y, const vector<int>& split);
+	float info_gain(const int* left, const int* right, int n_class, int n_left, int n_right, float current_impurity);
 
-	vector<float> get_unique_values(const VectorXf& col, const vector<int>& split);
+	template<class T>
+	Node* find_leaf_node(const T& x, Node* node);
 
-	vector<vector<int>> split_node(const Question& Q, const MatrixXf& X, const vector<int>& split);
+	void print_implementation(Node* node, int n_class, int width);
 
-	float info_gain(const VectorXi& Y, const vector<int>& left, const vector<int>& right, float current_impurity);
-	
-	vector<int> erase_taken_col(const Question& Q, const vector<int>& cols);
+	int majority_class(const int* counts, int n_class);
 
-	Node* find_leaf_node(const RowVectorXf& x, Node* node);
+	void export_branch(ofstream& fout, Node* node, int n_class, int width);
 
-	void print_implementation(Node* node, int width);
+	int export_table(ofstream& fout, Node* node, int n_class, int& n_node);
+
+	int count_nodes(Node* node);
+
+	void collect_counts(const Node* node, int n_class, vector<int>& counts);
 
 	/*---------------------------------------------------------------------------------------*/
 
-	DecisionTree::DecisionTree() : root(nullptr), n_class(0) {}
+	Arena::Arena(size_t block_size) : block_size(block_size), used(block_size) {}
+
+	template<class T>
+	T* Arena::allocate(size_t n)
+	{
+		// bump allocation; objects are never destroyed individually
+		size_t align = alignof(T);
+		size_t offset = (used + align - 1) / align * align;
+		size_t bytes = sizeof(T) * n;
+		if (blocks.empty() || offset + bytes > block_size) {
+			size_t size = std::max(block_size, bytes);
+			blocks.emplace_back(new char[size]);
+			offset = 0;
+		}
+		used = offset + bytes;
+		return reinterpret_cast<T*>(blocks.back().get() + offset);
+	}
+
+	void Arena::clear()
+	{
+		blocks.clear();
+		used = block_size;
+	}
+
+	int Arena::block_count() const { return (int)blocks.size(); }
 
-	DecisionTree::~DecisionTree() { delete root; }
+	DecisionTree::DecisionTree(int max_depth, int min_samples_split, float min_impurity_decrease) :
+		root(nullptr), n_class(0), max_depth(max_depth),
+		min_samples_split(min_samples_split), min_impurity_decrease(min_impurity_decrease), n_jobs(1),
+		n_node(0), links(nullptr), values(nullptr)
+	{
+		if (min_samples_split < 2) {
+			cout << "Error(DecisionTree(int, int, float)): min_samples_split must be at least 2." << endl;
+			exit(1);
+		}
+	}
 
-	void DecisionTree::fit(const MatrixXf& X, const VectorXi& Y)
+	DecisionTree::DecisionTree(const DecisionTree& other) :
+		root(nullptr), n_class(0), max_depth(other.max_depth),
+		min_samples_split(other.min_samples_split), min_impurity_decrease(other.min_impurity_decrease), n_jobs(1),
+		n_node(0), links(nullptr), values(nullptr)
 	{
-		vector<int> init_split(X.rows());
-		std::iota(init_split.begin(), init_split.end(), 0);
+		*this = other;
+	}
 
-		vector<int> init_cols(X.cols());
-		std::iota(init_cols.begin(), init_cols.end(), 0);
+	DecisionTree& DecisionTree::operator=(const DecisionTree& other)
+	{
+		// the nodes live in the other tree's arena, so they are cloned into ours
+		if (this == &other)
+			return *this;
+		max_depth = other.max_depth;
+		min_samples_split = other.min_samples_split;
+		min_impurity_decrease = other.min_impurity_decrease;
+		n_class = other.n_class;
+		report = other.report;
+		arena.clear();
+		root = other.root == nullptr ? nullptr : clone_node(other.root);
+		flatten_tree();
+		return *this;
+	}
 
-		build_tree(root, X, Y, init_split, init_cols);
+	void DecisionTree::flatten_tree()
+	{
+		mapping.reset();
+		node_links.clear();
+		node_values.clear();
+		if (root != nullptr)
+			flatten(root);
+		n_node = (int)node_values.size();
+		links = root != nullptr ? node_links.data() : nullptr;
+		values = root != nullptr ? node_values.data() : nullptr;
 	}
 
-	void build_tree(Node*& node, const MatrixXf& X, const VectorXi& Y,
-		const vector<int>& split, const vector<int>& cols)
+	int DecisionTree::flatten(const Node* node)
 	{
-		node = new Node;
-		node->labels = count_class(Y, split);
+		// pre-order like export_table; returns the index of node
+		int idx = (int)node_values.size();
+		node_values.push_back(node->Q.value);
+		node_links.insert(node_links.end(), { node->Q.col, -1, -1, majority_class(node->labels, n_class) });
+		if (node->left != nullptr && node->right != nullptr) {
+			int left = flatten(node->left);
+			int right = flatten(node->right);
+			node_links[4 * idx + 1] = left;
+			node_links[4 * idx + 2] = right;
+		}
+		return idx;
+	}
 
-		Question Q = find_best_question(X, Y, split, cols);
+	Node* DecisionTree::clone_node(const Node* node)
+	{
+		Node* copy = new (arena.allocate<Node>()) Node;
+		copy->Q = node->Q;
+		copy->labels = arena.allocate<int>(n_class);
+		std::copy(node->labels, node->labels + n_class, copy->labels);
+		if (node->left != nullptr)
+			copy->left = clone_node(node->left);
+		if (node->right != nullptr)
+			copy->right = clone_node(node->right);
+		return copy;
+	}
 
-		if (Q.gain >= 0.2) {
+	void DecisionTree::fit(const MatrixXf& X, const VectorXi& Y, int n_jobs)
+	{
+		// n_jobs splits the columns of large nodes; the tree is the same for every n_jobs
+		this->n_jobs = resolve_n_jobs(n_jobs);
+		report.reset();
+		auto start = chrono::steady_clock::now();
+
+		// free the previous tree in one shot
+		arena.clear();
+
+		n_class = *std::max_element(Y.data(), Y.data() + Y.size()) + 1;
+		left_counts.assign(n_class, 0);
+		right_counts.assign(n_class, 0);
+
+		// a single permutation buffer; each node owns a [first, last) range of it
+		vector<int> split(X.rows());
+		std::iota(split.begin(), split.end(), 0);
+
+		// columns not yet taken on the current path are kept in cols[0, n_cols)
+		cols.resize(X.cols());
+		std::iota(cols.begin(), cols.end(), 0);
+
+		root = build_tree(X, Y, split.data(), split.data() + split.size(), (int)cols.size(), 0);
+		flatten_tree();
+		SIMPLEML_COUNT(report, "arena_blocks", arena.block_count());
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	void DecisionTree::fit(const Dataset& X, const VectorXi& Y, int n_jobs)
+	{
+		// the split search sorts and scans one column at a time, so it runs on a column-major copy
+		fit(X.to_matrix(), Y, n_jobs);
+	}
+
+	Node* DecisionTree::build_tree(const MatrixXf& X, const VectorXi& Y,
+		int* first, int* last, int n_cols, int depth)
+	{
+		Node* node = new (arena.allocate<Node>()) Node;
+		node->labels = arena.allocate<int>(n_class);
+		count_class(Y, first, last, node->labels, n_class);
+		SIMPLEML_COUNT(report, "nodes_built", 1);
+
+		int size = (int)(last - first);
+		if (n_cols == 0 || size < min_samples_split || (max_depth >= 0 && depth >= max_depth))
+			return node;
+		if (gini(node->labels, n_class, size) == 0)
+			return node;
+
+		Question Q;
+		{
+			SIMPLEML_TIMER(report, "split_search");
+			Q = find_best_question(X, Y, first, last, node->labels, n_cols);
+		}
+		SIMPLEML_COUNT(report, "rows_scanned", (long long)size * n_cols);
+
+		if (Q.gain > 0 && Q.gain >= min_impurity_decrease) {
 			node->Q = Q;
 
-			vector<vector<int>> splits = split_node(Q, X, split);
-			vector<int> new_cols = erase_taken_col(Q, cols);
+			int* middle;
+			{
+				SIMPLEML_TIMER(report, "partition");
+				middle = partition_node(Q, X, first, last);
+			}
+
+			// move the taken column past the end of the active range
+			int* col_first = cols.data();
+			int* taken = std::find(col_first, col_first + n_cols, Q.col);
+			std::rotate(taken, taken + 1, col_first + n_cols);
+
+			node->left = build_tree(X, Y, first, middle, n_cols - 1, depth + 1);
+			node->right = build_tree(X, Y, middle, last, n_cols - 1, depth + 1);
 
-			build_tree(node->left, X, Y, splits[0], new_cols);
-			build_tree(node->right, X, Y, splits[1], new_cols);
+			// restore the column order for the siblings
+			std::rotate(taken, col_first + n_cols - 1, col_first + n_cols);
 		}
+		return node;
 	}
 
-	Question find_best_question(const MatrixXf& X, const VectorXi& Y,
-		const vector<int>& split, const vector<int>& cols)
+	Question DecisionTree::find_best_question(const MatrixXf& X, const VectorXi& Y,
+		int* first, int* last, const int* counts, int n_cols)
 	{
+		int size = (int)(last - first);
+		float current_impurity = gini(counts, n_class, size);
+
+		// small nodes are not worth a copy of their range per job
+		int jobs = size >= 2048 ? std::min(n_jobs, n_cols) : 1;
+		if (jobs <= 1) {
+			return find_best_question_in_columns(X, Y, first, last, counts, 0, n_cols,
+				left_counts.data(), right_counts.data(), current_impurity);
+		}
+
+		vector<Question> best(jobs);
+		parallel_for(0, n_cols, jobs, [&](int begin, int end, int job) {
+			// every job sorts its own copy of the range
+			vector<int> range(first, last);
+			vector<int> left(n_class), right(n_class);
+			best[job] = find_best_question_in_columns(X, Y, range.data(), range.data() + size, counts,
+				begin, end, left.data(), right.data(), current_impurity);
+		});
+
+		// combined in column order with the sequential tie-break (the later question wins)
 		Question best_Q;
 		best_Q.gain = 0;
-		
-		float current_impurity = gini(Y, split);
-		for (int idx : cols) {
-			vector<float> unique = get_unique_values(X.col(idx), split);
-			for (float value : unique) {
-				Question Q(idx, value);
-				vector<vector<int>> splits = split_node(Q, X, split);
-				if (splits[0].size() == 0 || splits[1].size() == 0) {
-					continue;
-				}
-				Q.gain = info_gain(Y, splits[0], splits[1], current_impurity);
-				if (Q.gain >= best_Q.gain) {
-					best_Q = Q;
+		for (const Question& Q : best) {
+			if (Q.gain >= best_Q.gain)
+				best_Q = Q;
+		}
+		return best_Q;
+	}
+
+	Question DecisionTree::find_best_question_in_columns(const MatrixXf& X, const VectorXi& Y, int* first, int* last,
+		const int* counts, int col_begin, int col_end, int* left, int* right, float current_impurity)
+	{
+		Question best_Q;
+		best_Q.gain = 0;
+
+		int size = (int)(last - first);
+		for (int c = col_begin; c < col_end; c++) {
+			int idx = cols[c];
+
+			// sort the range by the column, then sweep every threshold once
+			std::sort(first, last, [&](int i, int j) { return X(i, idx) < X(j, idx); });
+
+			// threshold v sends x >= v to the left, so everything starts on the left
+			std::copy(counts, counts + n_class, left);
+			std::fill(right, right + n_class, 0);
+
+			for (int i = 0; i < size; i++) {
+				float value = X(first[i], idx);
+				if (i > 0 && value != X(first[i - 1], idx)) {
+					Question Q(idx, value);
+					Q.gain = info_gain(left, right, n_class, size - i, i, current_impurity);
+					if (Q.gain >= best_Q.gain) {
+						best_Q = Q;
+					}
 				}
+				int label = Y[first[i]];
+				left[label]--;
+				right[label]++;
 			}
 		}
 		return best_Q;
 	}
 
-	float gini(const VectorXi& Y, const vector<int>& split)
+	float gini(const int* counts, int n_class, int size)
 	{
-		vector<int> counts = count_class(Y, split);
-
 		// calculate gini
 		float impurity = 1;
-		float split_size = (float)split.size();
-		for (int count : counts) {
-			impurity -= std::pow(count / split_size, 2.f);
+		float split_size = (float)size;
+		for (int i = 0; i < n_class; i++) {
+			impurity -= std::pow(counts[i] / split_size, 2.f);
 		}
 		return impurity;
 	}
 
-	float entropy(const VectorXi& Y, const vector<int>& split)
+	float entropy(const int* counts, int n_class, int size)
 	{
-		vector<int> counts = count_class(Y, split);
-
 		// calculate entropy
 		float impurity = 0;
-		float split_size = (float)split.size();
-		for (int count : counts) {
-			float prob = count / split_size;
+		float split_size = (float)size;
+		for (int i = 0; i < n_class; i++) {
+			if (counts[i] == 0)
+				continue;
+			float prob = counts[i] / split_size;
 			impurity -= prob * std::log2(prob);
 		}
 		return impurity;
 	}
 
-	vector<int> count_class(const VectorXi& Y, const vector<int>& split)
+	void count_class(const VectorXi& Y, const int* first, const int* last, int* counts, int n_class)
 	{
 		// count class
-		int n_class = (int)(*std::max_element(Y.data(), Y.data() + Y.size()) + 1);
-		vector<int> counts(n_class);
-		for (int idx : split) {
-			int label = (int)Y[idx];
-			counts[label]++;
+		std::fill(counts, counts + n_class, 0);
+		for (const int* idx = first; idx != last; idx++) {
+			counts[Y[*idx]]++;
 		}
-		return counts;
 	}
 
-	vector<float> get_unique_values(const VectorXf& col, const vector<int>& split)
+	int* partition_node(const Question& Q, const MatrixXf& X, int* first, int* last)
 	{
-		vector<float> unique;
-		for (int idx : split) {
-			// check if overlap
-			auto iter = std::find(unique.begin(), unique.end(), col[idx]);
-			if (iter == unique.end()) {
-				unique.push_back(col[idx]);
-			}
-		}
-		return unique;
+		// rows matching Q end up in [first, middle), the rest in [middle, last)
+		return std::partition(first, last, [&](int idx) { return X(idx, Q.col) >= Q.value; });
 	}
 
-	vector<vector<int>> split_node(const Question& Q, const MatrixXf& X, const vector<int>& split)
+	float info_gain(const int* left, const int* right, int n_class, int n_left, int n_right, float current_impurity)
 	{
-		vector<vector<int>> splits(2);
-		for (int idx : split) {
-			if (Q.match(X.row(idx)))
-				splits[0].push_back(idx);
-			else
-				splits[1].push_back(idx);
-		}
-		return splits;
+		float P = (float)n_left / (n_left + n_right);
+		return current_impurity - P * gini(left, n_class, n_left) - (1 - P) * gini(right, n_class, n_right);
 	}
 
-	float info_gain(const VectorXi& Y, const vector<int>& left, const vector<int>& right, float current_impurity)
-	{
-		float P = (float)left.size() / (left.size() + right.size());
-		return current_impurity - P * gini(Y, left) - (1 - P) * gini(Y, right);
-	}
+	VectorXi DecisionTree::predict(const MatrixXf& X, int n_jobs) { return predict_data(X, n_jobs); }
 
-	vector<int> erase_taken_col(const Question& Q, const vector<int>& cols)
-	{
-		vector<int> new_cols;
-		for (int idx : cols) {
-			if (idx != Q.col)
-				new_cols.push_back(idx);
-		}
-		return new_cols;
-	}
+	VectorXi DecisionTree::predict(const Dataset& X, int n_jobs) { return predict_data(X.view(), n_jobs); }
 
-	VectorXi DecisionTree::predict(const MatrixXf& X)
+	template<class Derived>
+	VectorXi DecisionTree::predict_data(const MatrixBase<Derived>& X, int n_jobs)
 	{
-		VectorXi labels(X.rows());
-		for (int i = 0; i < X.rows(); i++) {
-			Node* leaf = find_leaf_node(X.row(i), root);
-			auto max = std::max_element(leaf->labels.begin(), leaf->labels.end());
-			labels[i] = (int)std::distance(leaf->labels.begin(), max);
+		// walks the flattened nodes, which are contiguous (and may be the mapped file)
+		if (links == nullptr) {
+			cout << "Error(DecisionTree::predict(const MatrixXf&, int)): The model must be fitted first." << endl;
+			exit(1);
 		}
+		VectorXi labels(X.rows());
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+			for (int i = begin; i < end; i++) {
+				int idx = 0;
+				while (links[4 * idx + 1] >= 0)
+					idx = X(i, links[4 * idx]) >= values[idx] ? links[4 * idx + 1] : links[4 * idx + 2];
+				labels[i] = links[4 * idx + 3];
+			}
+		});
 		return labels;
 	}
 
-	Node* find_leaf_node(const RowVectorXf& x, Node* node)
+	template<class T>
+	Node* find_leaf_node(const T& x, Node* node)
 	{
 		while (node->left != nullptr && node->right != nullptr) {
 			if (node->Q.match(x)) {
@@ -241,17 +463,19 @@ namespace SimpleML
 		return node;
 	}
 
-	void DecisionTree::print_tree() 
-	{ 
+	const FitReport& DecisionTree::get_fit_report() const { return report; }
+
+	void DecisionTree::print_tree()
+	{
 		cout << "Decision tree: " << endl;
-		print_implementation(root, 0); 
+		print_implementation(root, n_class, 0);
 	}
 
-	void print_implementation(Node* node, int width)
+	void print_implementation(Node* node, int n_class, int width)
 	{
 		if (node->left == nullptr && node->right == nullptr) {
 			cout << setw(width + 4) << " " << "Predict : {";
-			for (int i = 0; i < node->labels.size(); i++)
+			for (int i = 0; i < n_class; i++)
 				cout << "'" << i << "' : " << node->labels[i] << ", ";
 			cout << "}" << endl;
 		}
@@ -260,10 +484,197 @@ namespace SimpleML
 				node->Q.value << " ? " << endl;
 
 			cout << setw(width) << " " << "--> True: " << endl;
-			print_implementation(node->left, width + 4);
+			print_implementation(node->left, n_class, width + 4);
 
 			cout << setw(width) << " " << "--> False: " << endl;
-			print_implementation(node->right, width + 4);
+			print_implementation(node->right, n_class, width + 4);
+		}
+	}
+
+	int majority_class(const int* counts, int n_class)
+	{
+		return (int)std::distance(counts, std::max_element(counts, counts + n_class));
+	}
+
+	void DecisionTree::export_cpp(string file_name, string function_name, string style)
+	{
+		if (root == nullptr) {
+			cout << "Error(DecisionTree::export_cpp(string, string, string)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		if (style != "branch" && style != "table") {
+			cout << "Error(DecisionTree::export_cpp(string, string, string)): Invalid style option." << endl;
+			exit(1);
+		}
+
+		ofstream fout(file_name);
+		if (!fout) {
+			cout << "Error(DecisionTree::export_cpp(string, string, string)): Cannot open file." << endl;
+			exit(1);
+		}
+
+		// 9 significant digits round-trip every float threshold exactly
+		fout << setprecision(9) << showpoint;
+		fout << "// Generated by SimpleML::DecisionTree::export_cpp. Do not edit." << endl;
+		fout << "// " << function_name << "(x) takes one row of features (in training column order)" << endl;
+		fout << "// and returns the same class as DecisionTree::predict." << endl;
+		fout << "#pragma once" << endl << endl;
+
+		if (style == "branch") {
+			fout << "inline int " << function_name << "(const float* x)" << endl;
+			fout << "{" << endl;
+			export_branch(fout, root, n_class, 1);
+			fout << "}" << endl;
+		}
+		else {
+			/*
+				nodes are stored in pre-order; a leaf has left == -1 and holds the label.
+				eval<I> is instantiated once per node, so the whole tree is unrolled
+				into straight-line compares at compile time.
+			*/
+			fout << "namespace " << function_name << "_detail" << endl;
+			fout << "{" << endl;
+			fout << "\tstruct Node { int col; float value; int left; int right; int label; };" << endl << endl;
+			fout << "\tconstexpr Node nodes[] = {" << endl;
+			int n_node = 0;
+			export_table(fout, root, n_class, n_node);
+			fout << "\t};" << endl << endl;
+			fout << "\ttemplate<int I>" << endl;
+			fout << "\tinline int eval(const float* x)" << endl;
+			fout << "\t{" << endl;
+			fout << "\t\tif constexpr (nodes[I].left < 0)" << endl;
+			fout << "\t\t\treturn nodes[I].label;" << endl;
+			fout << "\t\telse" << endl;
+			fout << "\t\t\treturn x[nodes[I].col] >= nodes[I].value ? eval<nodes[I].left>(x) : eval<nodes[I].right>(x);" << endl;
+			fout << "\t}" << endl;
+			fout << "}" << endl << endl;
+			fout << "inline int " << function_name << "(const float* x) { return " <<
+				function_name << "_detail::eval<0>(x); }" << endl;
+		}
+		fout.close();
+	}
+
+	void export_branch(ofstream& fout, Node* node, int n_class, int width)
+	{
+		string indent(width, '\t');
+		if (node->left == nullptr && node->right == nullptr) {
+			fout << indent << "return " << majority_class(node->labels, n_class) << ";" << endl;
 		}
+		else {
+			fout << indent << "if (x[" << node->Q.col << "] >= " << node->Q.value << "f) {" << endl;
+			export_branch(fout, node->left, n_class, width + 1);
+			fout << indent << "}" << endl;
+			fout << indent << "else {" << endl;
+			export_branch(fout, node->right, n_class, width + 1);
+			fout << indent << "}" << endl;
+		}
+	}
+
+	int export_table(ofstream& fout, Node* node, int n_class, int& n_node)
+	{
+		// emits the subtree rooted at node and returns its index
+		int idx = n_node++;
+		if (node->left == nullptr && node->right == nullptr) {
+			fout << "\t\t{ 0, 0.f, -1, -1, " << majority_class(node->labels, n_class) << " }," << endl;
+			return idx;
+		}
+
+		// pre-order: the right subtree starts after the whole left subtree
+		int left = idx + 1;
+		int right = left + count_nodes(node->left);
+		fout << "\t\t{ " << node->Q.col << ", " << node->Q.value << "f, " << left << ", " << right << ", -1 }," << endl;
+		export_table(fout, node->left, n_class, n_node);
+		export_table(fout, node->right, n_class, n_node);
+		return idx;
+	}
+
+	int count_nodes(Node* node)
+	{
+		if (node == nullptr)
+			return 0;
+		return 1 + count_nodes(node->left) + count_nodes(node->right);
+	}
+
+	void collect_counts(const Node* node, int n_class, vector<int>& counts)
+	{
+		// class counts of every node, in the pre-order of DecisionTree::flatten
+		counts.insert(counts.end(), node->labels, node->labels + n_class);
+		if (node->left != nullptr && node->right != nullptr) {
+			collect_counts(node->left, n_class, counts);
+			collect_counts(node->right, n_class, counts);
+		}
+	}
+
+	void DecisionTree::save(const string& path) const
+	{
+		if (root == nullptr) {
+			cout << "Error(DecisionTree::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		vector<int> counts;
+		collect_counts(root, n_class, counts);
+
+		ModelWriter writer(path, "DecisionTree", 1);
+		writer.write_int(max_depth);
+		writer.write_int(min_samples_split);
+		writer.write_double(min_impurity_decrease);
+		writer.write_int(n_class);
+		writer.write_array(links, n_node, 4, true);
+		writer.write_array(values, n_node, 1, false);
+		writer.write_array(counts.data(), n_node, n_class, true);
+		writer.close();
+	}
+
+	void DecisionTree::load(const string& path)
+	{
+		/*
+			predict walks the node table and thresholds inside the mapped file.
+			The node graph (print_tree, export_cpp, copies) is rebuilt in the arena.
+		*/
+		ModelReader reader(path, "DecisionTree", 1);
+		max_depth = (int)reader.read_int();
+		min_samples_split = (int)reader.read_int();
+		min_impurity_decrease = (float)reader.read_double();
+		n_class = (int)reader.read_int();
+		Index rows, cols, n_value, value_cols, n_count, count_cols;
+		const int* table = reader.read_array<int>(rows, cols, true);
+		const float* thresholds = reader.read_array<float>(n_value, value_cols, false);
+		const int* counts = reader.read_array<int>(n_count, count_cols, true);
+
+		// children come after their parent, so a valid table has no cycles
+		bool valid = rows > 0 && cols == 4 && n_value == rows && value_cols == 1 && n_count == rows && count_cols == n_class;
+		for (Index idx = 0; valid && idx < rows; idx++) {
+			int left = table[4 * idx + 1], right = table[4 * idx + 2], label = table[4 * idx + 3];
+			if (left >= 0)
+				valid = left > idx && right > idx && left < rows && right < rows && table[4 * idx] >= 0;
+			else
+				valid = label >= 0 && label < n_class;
+		}
+		if (!valid) {
+			cout << "Error(DecisionTree::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
+
+		node_links.clear();
+		node_values.clear();
+		n_node = (int)rows;
+		links = table;
+		values = thresholds;
+		mapping = reader.mapping();
+		arena.clear();
+		root = rebuild_node(0, counts);
+	}
+
+	Node* DecisionTree::rebuild_node(int idx, const int* counts)
+	{
+		Node* node = new (arena.allocate<Node>()) Node;
+		node->Q = Question(links[4 * idx], values[idx]);
+		node->labels = arena.allocate<int>(n_class);
+		std::copy(counts + (size_t)idx * n_class, counts + (size_t)(idx + 1) * n_class, node->labels);
+		if (links[4 * idx + 1] >= 0) {
+			node->left = rebuild_node(links[4 * idx + 1], counts);
+			node->right = rebuild_node(links[4 * idx + 2], counts);
+		}
+		return node;
 	}
 }
\ No newline at end of file
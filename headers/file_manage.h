@@ -4,7 +4,10 @@
 #include <sstream>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <type_traits>
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 using namespace std;
 using namespace Eigen;
 
@@ -52,6 +55,38 @@ namespace SimpleML {
 		return true;
 	}
 
+	template<class T>
+	void parse_row(const string& line, MatrixXf& features, Matrix<T, Dynamic, 1>& labels,
+		int row, vector<string>& str_labels)
+	{
+		string str;
+		stringstream ss(line);
+
+		// read features
+		for (int col = 0; col < features.cols(); col++) {
+			std::getline(ss, str, ',');
+			features(row, col) = std::stof(str);
+		}
+
+		// the remaining field is the label
+		std::getline(ss, str, ',');
+
+		// read labels
+		if (is_number(str)) {
+			labels[row] = std::stof(str);
+		}
+		else {
+			auto iter = std::find(str_labels.begin(), str_labels.end(), str);
+			if (iter != str_labels.end()) {
+				labels[row] = (int)std::distance(str_labels.begin(), iter);
+			}
+			else {
+				str_labels.push_back(str);
+				labels[row] = (int)str_labels.size() - 1;
+			}
+		}
+	}
+
 	template<class T>
 	void read_csv(string file_name, MatrixXf& features, Matrix<T, Dynamic, 1>& labels)
 	{
@@ -73,40 +108,155 @@ namespace SimpleML {
 		string line;
 		getline(fin, line);
 
-		int row = 0, col = 0;
+		int row = 0;
 		vector<string> str_labels;
 		while (fin >> line) {
-			string str;
+			parse_row(line, features, labels, row, str_labels);
+			row++;
+		}
+
+		fin.close();
+	}
+
+	class CsvChunkReader
+	{
+	private:
+		ifstream fin;
+		int n_col;
+		vector<string> str_labels;
+	public:
+		CsvChunkReader(string file_name);
+		template<class T>
+		int read(MatrixXf& features, Matrix<T, Dynamic, 1>& labels, int chunk_size);
+	};
+
+	CsvChunkReader::CsvChunkReader(string file_name) : fin(file_name), n_col(0)
+	{
+		if (!fin) {
+			cout << "Error(CsvChunkReader(string)): File not found." << endl;
+			exit(1);
+		}
+
+		// the first row is column name, and the last column is label
+		string line, str;
+		getline(fin, line);
+		stringstream ss(line);
+		while (std::getline(ss, str, ',')) {
+			n_col++;
+		}
+		n_col--;
+	}
+
+	template<class T>
+	int CsvChunkReader::read(MatrixXf& features, Matrix<T, Dynamic, 1>& labels, int chunk_size)
+	{
+		/*
+			reads up to chunk_size rows into features and labels and returns the
+			number of rows read (0 at the end of the file). String labels keep
+			the same ids across chunks.
+		*/
+		features.resize(chunk_size, n_col);
+		labels.resize(chunk_size);
+
+		int row = 0;
+		string line;
+		while (row < chunk_size && fin >> line) {
+			parse_row(line, features, labels, row, str_labels);
+			row++;
+		}
+
+		if (row < chunk_size) {
+			features.conservativeResize(row, n_col);
+			labels.conservativeResize(row);
+		}
+		return row;
+	}
+
+	template<class T>
+	void read_libsvm(string file_name, SparseMatrix<float, RowMajor>& features, Matrix<T, Dynamic, 1>& labels,
+		int n_col = 0)
+	{
+		/*
+			"label index:value index:value ..." per line, indices 1-based; the rows
+			are read straight into compressed (CSR) arrays, so memory is proportional
+			to the number of non-zeros. n_col 0 takes the largest index in the file,
+			give it explicitly so that e.g. a test file has the columns of the
+			training file. Integer labels are class labels and are renumbered
+			0..C-1 in increasing order (e.g. -1 / +1 become 0 / 1), as the
+			classifiers index by label; floating-point targets are stored as they are.
+		*/
+		ifstream fin(file_name);
+		if (!fin) {
+			cout << "Error(read_libsvm(string, SparseMatrix<float, RowMajor>&, Matrix<T, Dynamic, 1>&, int)): ";
+			cout << "File not found." << endl;
+			exit(1);
+		}
+
+		vector<int> outer(1, 0);
+		vector<int> inner;
+		vector<float> values;
+		vector<T> targets;
+		vector<pair<int, float>> entries;
+		int max_index = 0;
+
+		string line, token;
+		while (std::getline(fin, line)) {
 			stringstream ss(line);
+			if (!(ss >> token) || token[0] == '#')
+				continue;
+			targets.push_back((T)std::stof(token));
 
-			// read features
-			while (std::getline(ss, str, ',')) {
-				if (col == n_col - 1) {
-					col = 0;
+			entries.clear();
+			while (ss >> token) {
+				size_t colon = token.find(':');
+				if (token[0] == '#')
 					break;
+				int index = colon == string::npos ? 0 : std::stoi(token.substr(0, colon));
+				if (index < 1) {
+					cout << "Error(read_libsvm(string, SparseMatrix<float, RowMajor>&, Matrix<T, Dynamic, 1>&, int)): ";
+					cout << "Invalid entry \"" << token << "\" in row " << targets.size() << "." << endl;
+					exit(1);
 				}
-				features(row, col) = std::stof(str);
-				col++;
+				entries.emplace_back(index - 1, std::stof(token.substr(colon + 1)));
 			}
 
-			// read labels
-			if (is_number(str)) {
-				labels[row] = std::stof(str);
-			}
-			else {
-				auto iter = std::find(str_labels.begin(), str_labels.end(), str);
-				if (iter != str_labels.end()) {
-					labels[row] = (int)std::distance(str_labels.begin(), iter);
-				}
-				else {
-					str_labels.push_back(str);
-					labels[row] = (int)str_labels.size() - 1;
+			// indices are usually increasing already
+			if (!std::is_sorted(entries.begin(), entries.end()))
+				std::sort(entries.begin(), entries.end());
+			for (size_t k = 0; k < entries.size(); k++) {
+				if (k > 0 && entries[k].first == entries[k - 1].first) {
+					cout << "Error(read_libsvm(string, SparseMatrix<float, RowMajor>&, Matrix<T, Dynamic, 1>&, int)): ";
+					cout << "Duplicate index in row " << targets.size() << "." << endl;
+					exit(1);
 				}
+				inner.push_back(entries[k].first);
+				values.push_back(entries[k].second);
 			}
+			if (!entries.empty())
+				max_index = std::max(max_index, entries.back().first + 1);
+			outer.push_back((int)inner.size());
+		}
+		fin.close();
 
-			row++;
+		if (n_col == 0)
+			n_col = max_index;
+		if (max_index > n_col) {
+			cout << "Error(read_libsvm(string, SparseMatrix<float, RowMajor>&, Matrix<T, Dynamic, 1>&, int)): ";
+			cout << "Index " << max_index << " exceeds n_col." << endl;
+			exit(1);
 		}
 
-		fin.close();
+		int n_row = (int)targets.size();
+		features = Map<const SparseMatrix<float, RowMajor>>(n_row, n_col, (int)values.size(),
+			outer.data(), inner.data(), values.data());
+		labels = Map<const Matrix<T, Dynamic, 1>>(targets.data(), n_row);
+
+		if (std::is_integral<T>::value) {
+			vector<T> classes(targets);
+			std::sort(classes.begin(), classes.end());
+			classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+			for (int i = 0; i < n_row; i++)
+				labels[i] = (T)std::distance(classes.begin(), std::lower_bound(classes.begin(), classes.end(), targets[i]));
+		}
 	}
 }
\ No newline at end of file
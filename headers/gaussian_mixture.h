@@ -7,105 +7,177 @@
 #include <numeric>
 #include <Eigen/Dense>
 #include "common.h"
+#include "dataset.h"
 #include "k_means.h"
+#include "parallel.h"
+#include "instrumentation.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
 namespace SimpleML
 {
-	class GaussianMixture
+	/*
+		Scalar is the type of the data and the parameters; the E-step
+		normalization, the M-step sums and the log-likelihood are computed in
+		Accumulator (e.g. float data with double sums).
+	*/
+	template<class Scalar, class Accumulator = Scalar>
+	class BasicGaussianMixture
 	{
 	private:
 		int K;
-		MatrixXf posterior;
-		RowVectorXf phi;
-		RowVectorXf* mu;
-		MatrixXf* sigma;
+		MatrixT<Scalar> posterior;
+		RowVectorT<Scalar> phi;
+		RowVectorT<Scalar>* mu;
+		MatrixT<Scalar>* sigma;
+		FitReport report;
+		FitCallback callback;
 	public:
-		GaussianMixture(int K);
-		~GaussianMixture();
-		void fit(const MatrixXf& X, string init = "kmeans");
-		vector<vector<int>> predict(const MatrixXf& X);
+		BasicGaussianMixture(int K);
+		~BasicGaussianMixture();
+		void fit(const MatrixT<Scalar>& X, string init = "kmeans", int n_jobs = 1);
+		void fit(const MatrixT<Scalar>& X, int n_jobs);
+		void fit(const BasicDataset<Scalar>& X, string init = "kmeans", int n_jobs = 1);
+		void fit(const BasicDataset<Scalar>& X, int n_jobs);
+		vector<vector<int>> predict(const MatrixT<Scalar>& X, int n_jobs = 1);
+		vector<vector<int>> predict(const BasicDataset<Scalar>& X, int n_jobs = 1);
+		const FitReport& get_fit_report() const;
+		void set_callback(FitCallback callback);
+		RowVectorT<Scalar> get_phi() const;
+		const RowVectorT<Scalar>* get_mu() const;
+		const MatrixT<Scalar>* get_sigma() const;
+		void save(const string& path) const;
+		void load(const string& path);
 	private:
-		void random_init(const MatrixXf& X);
-		void kmeans_init(const MatrixXf& X);
-		void e_step(const MatrixXf& X);
-		void m_step(const MatrixXf& X);
+		template<class Derived>
+		void fit_data(const MatrixBase<Derived>& X, string init, int n_jobs);
+		template<class Derived>
+		vector<vector<int>> predict_data(const MatrixBase<Derived>& X, int n_jobs);
+		template<class Derived>
+		void random_init(const MatrixBase<Derived>& X, int n_jobs);
+		template<class Derived>
+		void kmeans_init(const MatrixBase<Derived>& X, int n_jobs);
+		template<class Derived>
+		void e_step(const MatrixBase<Derived>& X, int n_jobs);
+		template<class Derived>
+		void m_step(const MatrixBase<Derived>& X, int n_jobs);
 	};
 
-	GaussianMixture::GaussianMixture(int K) :
+	typedef BasicGaussianMixture<float> GaussianMixture;
+	typedef BasicGaussianMixture<double> GaussianMixtured;
+
+	/*---------------------------------------------------------------------------------------*/
+
+	template<class Scalar, class Accumulator>
+	BasicGaussianMixture<Scalar, Accumulator>::BasicGaussianMixture(int K) :
 		K(K), mu(nullptr), sigma(nullptr)
 	{
-		mu = new RowVectorXf[K];
-		sigma = new MatrixXf[K];
+		mu = new RowVectorT<Scalar>[K];
+		sigma = new MatrixT<Scalar>[K];
 	}
 	
-	GaussianMixture::~GaussianMixture()
+	template<class Scalar, class Accumulator>
+	BasicGaussianMixture<Scalar, Accumulator>::~BasicGaussianMixture()
 	{
 		delete[] mu;
 		delete[] sigma;
 	}
 
-	void GaussianMixture::fit(const MatrixXf& X, string init)
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::fit(const MatrixT<Scalar>& X, string init, int n_jobs)
+	{
+		fit_data(X, init, n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::fit(const BasicDataset<Scalar>& X, string init, int n_jobs)
+	{
+		fit_data(X.view(), init, n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicGaussianMixture<Scalar, Accumulator>::fit_data(const MatrixBase<Derived>& X, string init, int n_jobs)
 	{
 		if (init != "kmeans" && init != "random") {
-			cout << "Error(GaussianMixture::fit(const MatrixXf, string): Invalid argument." << endl;
+			cout << "Error(BasicGaussianMixture::fit(const MatrixT<Scalar>&, string, int)): Invalid argument." << endl;
 			exit(1);
 		}
 
-		if (init == "random") 
-			random_init(X);
-		else 
-			kmeans_init(X);
+		// the history is the log-likelihood after every EM step
+		report.reset();
+		auto start = chrono::steady_clock::now();
+		{
+			SIMPLEML_TIMER(report, "init");
+			if (init == "random")
+				random_init(X, n_jobs);
+			else
+				kmeans_init(X, n_jobs);
+		}
 
 		int i = 1;
-		float prev = 0.f, curr;
+		Accumulator prev = 0, curr;
 		while (1) {
-			e_step(X);
-			m_step(X);
+			{
+				SIMPLEML_TIMER(report, "e_step");
+				e_step(X, n_jobs);
+			}
+			{
+				SIMPLEML_TIMER(report, "m_step");
+				m_step(X, n_jobs);
+			}
+			{
+				SIMPLEML_TIMER(report, "log_likelihood");
+				curr = multivariate_log_likelihood<Scalar, Accumulator>(X, phi, mu, sigma, K, n_jobs);
+			}
+			// e_step and the log-likelihood evaluate every density once
+			SIMPLEML_COUNT(report, "density_evaluations", 2LL * X.rows() * K);
 
-			curr = multivariate_log_likelihood(X, phi, mu, sigma, K);
-			
-			/*cout << "Epoch " << i << " ]";
-			cout << " --> log-likelihood: " << curr << endl;*/
+			report.n_iter = i;
+			report.history.push_back(curr);
+			if (callback)
+				callback(report);
 
-			if ((prev != 0) && (std::fabs(curr - prev) < 0.01))
+			if ((prev != 0) && (std::fabs(curr - prev) < 0.01)) {
+				report.converged = true;
 				break;
+			}
 
 			prev = curr;
 
 			if (i > 1000) {
-				cout << "Warning(GaussianMixture::fit(const MatrixXf&, int)): ";
+				cout << "Warning(BasicGaussianMixture::fit(const MatrixT<Scalar>&, string, int)): ";
 				cout << "iteration exceeded 1000 times" << endl;
 				break;
 			}
 
 			i++;
 		}
-
-		cout << endl << "[ Model fit result ]" << endl;
-		cout << "Phi: " << endl << phi << endl << endl;
-		for (int i = 0; i < K; i++) {
-			cout << "Mu" << i + 1 << ": " << endl;
-			cout << mu[i] << endl << endl;
-			cout << "Sigma" << i + 1 << ": " << endl;
-			cout << sigma[i] << endl << endl;
-		}
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
 	}
 
-	void GaussianMixture::random_init(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::fit(const MatrixT<Scalar>& X, int n_jobs) { fit(X, "kmeans", n_jobs); }
+
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::fit(const BasicDataset<Scalar>& X, int n_jobs) { fit(X, "kmeans", n_jobs); }
+
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicGaussianMixture<Scalar, Accumulator>::random_init(const MatrixBase<Derived>& X, int n_jobs)
 	{
 		int N = (int)X.rows();
 
 		// initialize posterior prob and phi
-		posterior = MatrixXf::Constant(N, K, 1.f / K);
-		phi = RowVectorXf::Constant(K, 1.f / K);
+		posterior = MatrixT<Scalar>::Constant(N, K, (Scalar)1 / K);
+		phi = RowVectorT<Scalar>::Constant(K, (Scalar)1 / K);
 
 		// generate random row index
 		vector<int> indicies = generate_random_index(N);
 
 		// calculate cov matrix
-		MatrixXf cov = covariance_matrix(X);
+		MatrixT<Scalar> cov = covariance_matrix(X, n_jobs);
 
 		// initialize mu and sigma
 		for (int i = 0; i < K; i++) {
@@ -114,28 +186,31 @@ namespace SimpleML
 		}
 	}
 
-	void GaussianMixture::kmeans_init(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicGaussianMixture<Scalar, Accumulator>::kmeans_init(const MatrixBase<Derived>& X, int n_jobs)
 	{
 		int N = (int)X.rows();
 
 		// initialize posterior prob
-		posterior = MatrixXf::Constant(N, K, 1.f / K);
+		posterior = MatrixT<Scalar>::Constant(N, K, (Scalar)1 / K);
 
-		KMeans kmeans(K);
-		kmeans.fit(X);
-		vector<vector<int>> clusters = kmeans.predict(X);
+		// on X as it is, whatever its layout (BasicKMeans is a friend)
+		BasicKMeans<Scalar, Accumulator> kmeans(K);
+		kmeans.fit_data(X, "kmpp", n_jobs);
+		vector<vector<int>> clusters = kmeans.make_clusters(X, n_jobs);
 
 		// initialize phi
 		phi.resize(K);
 		for (int i = 0; i < K; i++) {
-			phi[i] = clusters[i].size() / (float)N;
+			phi[i] = (Scalar)(clusters[i].size() / (Accumulator)N);
 		}
 
-		const RowVectorXf* centers = kmeans.get_centers();
+		const RowVectorT<Scalar>* centers = kmeans.get_centers();
 
 		// initializ mu and sigma
 		for (int i = 0; i < clusters.size(); i++) {
-			MatrixXf temp(clusters[i].size(), X.cols());
+			MatrixT<Scalar> temp(clusters[i].size(), X.cols());
 			for (int j = 0; j < clusters[i].size(); j++) {
 				temp.row(j) = X.row(clusters[i][j]);
 			}
@@ -144,7 +219,9 @@ namespace SimpleML
 		}
 	}
 
-	void GaussianMixture::e_step(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicGaussianMixture<Scalar, Accumulator>::e_step(const MatrixBase<Derived>& X, int n_jobs)
 	{
 		/*
 			posterior(i, j) = P(j'th gaussian | x_i)
@@ -157,43 +234,186 @@ namespace SimpleML
 							= -----------------------------------------
 							  Sigma_{k=1}^{K} phi_k * N(x_i | M_k, S_k)
 		*/
-		for (int i = 0; i < X.rows(); i++) {
-			float denominator = 0;
-			for (int k = 0; k < K; k++) {
-				denominator += phi[k] * multivariate_normal(X.row(i), mu[k], sigma[k]);
+		dispatch_dimension((int)X.cols(), [&](auto dim) {
+			constexpr int D = decltype(dim)::value;
+			GaussianDensities<Scalar, D> density = gaussian_densities<D>(mu, sigma, K);
+			parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+				vector<Accumulator> numerator(K);
+				for (int i = begin; i < end; i++) {
+					Accumulator denominator = 0;
+					for (int k = 0; k < K; k++) {
+						numerator[k] = (Accumulator)phi[k] * density[k](X.row(i));
+						denominator += numerator[k];
+					}
+					for (int j = 0; j < K; j++) {
+						posterior(i, j) = (Scalar)(numerator[j] / denominator);
+					}
+				}
+			});
+		});
+	}
+
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicGaussianMixture<Scalar, Accumulator>::m_step(const MatrixBase<Derived>& X, int n_jobs)
+	{
+		/*
+			two passes over blocks of rows widened to Accumulator, as in
+			covariance_matrix_double: the weighted sums give the means, then the
+			weighted scatter about them the covariances. X is never copied as a
+			whole and a row-major X is read a row at a time. Jobs take contiguous
+			row ranges and their partial sums are added in order.
+		*/
+		const int block_size = 1024;
+		int N = (int)X.rows(), d = (int)X.cols();
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), N));
+
+		// K x (d + 1): the weighted sums of x, then the sums of the weights
+		vector<MatrixT<Accumulator>> partial_sums(n_jobs);
+		parallel_for(0, N, n_jobs, [&](int begin, int end, int job) {
+			MatrixT<Accumulator>& sums = partial_sums[job];
+			sums = MatrixT<Accumulator>::Zero(K, d + 1);
+			for (int first = begin; first < end; first += block_size) {
+				int rows = std::min(block_size, end - first);
+				MatrixT<Accumulator> block = X.middleRows(first, rows).template cast<Accumulator>();
+				MatrixT<Accumulator> weight = posterior.middleRows(first, rows).template cast<Accumulator>();
+				sums.leftCols(d).noalias() += weight.transpose() * block;
+				sums.col(d) += weight.colwise().sum().transpose();
 			}
-			for (int j = 0; j < K; j++) {
-				float numerator = phi[j] * multivariate_normal(X.row(i), mu[j], sigma[j]);
-				posterior(i, j) = numerator / denominator;
+		});
+		MatrixT<Accumulator> sums = partial_sums[0];
+		for (int job = 1; job < n_jobs; job++)
+			sums += partial_sums[job];
+		VectorT<Accumulator> N_k = sums.col(d);
+		MatrixT<Accumulator> means = sums.leftCols(d).array().colwise() / N_k.array();
+
+		// sum_i w_ij * (x_i - mu_j)t * (x_i - mu_j) as a rank update with the rows scaled by sqrt(w_ij)
+		vector<vector<MatrixT<Accumulator>>> partial_scatter(n_jobs);
+		parallel_for(0, N, n_jobs, [&](int begin, int end, int job) {
+			vector<MatrixT<Accumulator>>& scatter = partial_scatter[job];
+			scatter.assign(K, MatrixT<Accumulator>::Zero(d, d));
+			for (int first = begin; first < end; first += block_size) {
+				int rows = std::min(block_size, end - first);
+				MatrixT<Accumulator> block = X.middleRows(first, rows).template cast<Accumulator>();
+				MatrixT<Accumulator> weight = posterior.middleRows(first, rows).template cast<Accumulator>();
+				for (int j = 0; j < K; j++) {
+					MatrixT<Accumulator> centered = (block.rowwise() - means.row(j)).array().colwise() *
+						weight.col(j).array().sqrt();
+					scatter[j].template selfadjointView<Lower>().rankUpdate(centered.transpose());
+				}
 			}
+		});
+
+		for (int j = 0; j < K; j++) {
+			MatrixT<Accumulator> scatter = partial_scatter[0][j];
+			for (int job = 1; job < n_jobs; job++)
+				scatter += partial_scatter[job][j];
+			MatrixT<Accumulator> cov = scatter.template selfadjointView<Lower>();
+
+			mu[j] = means.row(j).template cast<Scalar>();
+			sigma[j] = (cov / N_k[j]).template cast<Scalar>();
+			phi[j] = (Scalar)(N_k[j] / N);
 		}
 	}
 
-	void GaussianMixture::m_step(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	vector<vector<int>> BasicGaussianMixture<Scalar, Accumulator>::predict(const MatrixT<Scalar>& X, int n_jobs)
 	{
-		int N = (int)X.rows();
-		for (int j = 0; j < K; j++) {
-			float N_j = posterior.col(j).sum();
-			mu[j] = (X.array().colwise() * posterior.col(j).array()).colwise().sum() / N_j;
+		return predict_data(X, n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	vector<vector<int>> BasicGaussianMixture<Scalar, Accumulator>::predict(const BasicDataset<Scalar>& X, int n_jobs)
+	{
+		return predict_data(X.view(), n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	vector<vector<int>> BasicGaussianMixture<Scalar, Accumulator>::predict_data(const MatrixBase<Derived>& X, int n_jobs)
+	{
+		VectorXi labels(X.rows());
+		dispatch_dimension((int)X.cols(), [&](auto dim) {
+			constexpr int D = decltype(dim)::value;
+			GaussianDensities<Scalar, D> density = gaussian_densities<D>(mu, sigma, K);
+			parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+				vector<Scalar> probs(K);
+				for (int i = begin; i < end; i++) {
+					for (int j = 0; j < K; j++) {
+						probs[j] = density[j](X.row(i));
+					}
+					labels[i] = (int)std::distance(probs.begin(), std::max_element(probs.begin(), probs.end()));
+				}
+			});
+		});
+
+		vector<vector<int>> clusters(K);
+		for (int i = 0; i < X.rows(); i++)
+			clusters[labels[i]].push_back(i);
+		return clusters;
+	}
+
+	template<class Scalar, class Accumulator>
+	const FitReport& BasicGaussianMixture<Scalar, Accumulator>::get_fit_report() const { return report; }
+
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::set_callback(FitCallback callback) { this->callback = callback; }
 
-			MatrixXf centered = X.rowwise() - mu[j];
-			sigma[j] = centered.transpose() * posterior.col(j).asDiagonal() * centered / N_j;
+	template<class Scalar, class Accumulator>
+	RowVectorT<Scalar> BasicGaussianMixture<Scalar, Accumulator>::get_phi() const { return phi; }
 
-			phi[j] = N_j / N;
+	template<class Scalar, class Accumulator>
+	const RowVectorT<Scalar>* BasicGaussianMixture<Scalar, Accumulator>::get_mu() const { return mu; }
+
+	template<class Scalar, class Accumulator>
+	const MatrixT<Scalar>* BasicGaussianMixture<Scalar, Accumulator>::get_sigma() const { return sigma; }
+
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::save(const string& path) const
+	{
+		// mu is K x d, the covariances are stacked into a (K * d) x d matrix
+		if (phi.size() != K) {
+			cout << "Error(BasicGaussianMixture::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
 		}
+		int d = (int)mu[0].size();
+		MatrixT<Scalar> means(K, d), covariances(K * d, d);
+		for (int j = 0; j < K; j++) {
+			means.row(j) = mu[j];
+			covariances.middleRows(j * d, d) = sigma[j];
+		}
+		ModelWriter writer(path, "GaussianMixture", 1);
+		writer.write_int(K);
+		writer.write_array(phi);
+		writer.write_array(means);
+		writer.write_array(covariances);
+		writer.close();
 	}
 
-	vector<vector<int>> GaussianMixture::predict(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	void BasicGaussianMixture<Scalar, Accumulator>::load(const string& path)
 	{
-		vector<vector<int>> clusters(K);
-		for (int i = 0; i < X.rows(); i++) {
-			vector<float> probs(K);
-			for (int j = 0; j < K; j++) {
-				probs[j] = multivariate_normal(X.row(i), mu[j], sigma[j]);
-			}
-			int max = (int)std::distance(probs.begin(), std::max_element(probs.begin(), probs.end()));
-			clusters[max].push_back(i);
+		ModelReader reader(path, "GaussianMixture", 1);
+		int n_component = (int)reader.read_int();
+		MatrixT<Scalar> means, covariances;
+		reader.read_matrix(phi);
+		reader.read_matrix(means);
+		reader.read_matrix(covariances);
+		int d = (int)means.cols();
+		if (phi.size() != n_component || means.rows() != n_component ||
+			covariances.rows() != (Index)n_component * d || covariances.cols() != d) {
+			cout << "Error(BasicGaussianMixture::load(const string&)): Corrupt model file." << endl;
+			exit(1);
 		}
-		return clusters;
+		delete[] mu;
+		delete[] sigma;
+		K = n_component;
+		mu = new RowVectorT<Scalar>[K];
+		sigma = new MatrixT<Scalar>[K];
+		for (int j = 0; j < K; j++) {
+			mu[j] = means.row(j);
+			sigma[j] = covariances.middleRows(j * d, d);
+		}
+		posterior.resize(0, 0);
 	}
-}
\ No newline at end of file
+}
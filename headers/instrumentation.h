@@ -0,0 +1,115 @@
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+using namespace std;
+
+/*
+	Phase timers and counters are compiled in only with -DSIMPLEML_PROFILE;
+	otherwise SIMPLEML_TIMER and SIMPLEML_COUNT expand to nothing and their
+	arguments are never evaluated. The per-fit totals (fit time, iterations,
+	convergence history) and the iteration callbacks are always available.
+*/
+#ifdef SIMPLEML_PROFILE
+#define SIMPLEML_CONCAT_IMPL(a, b) a##b
+#define SIMPLEML_CONCAT(a, b) SIMPLEML_CONCAT_IMPL(a, b)
+#define SIMPLEML_TIMER(report, phase) SimpleML::ScopedTimer SIMPLEML_CONCAT(simpleml_timer_, __LINE__)(report, phase)
+#define SIMPLEML_COUNT(report, counter, n) (report).count(counter, n)
+#else
+#define SIMPLEML_TIMER(report, phase) ((void)0)
+#define SIMPLEML_COUNT(report, counter, n) ((void)0)
+#endif
+
+namespace SimpleML
+{
+	struct PhaseStat
+	{
+		double total_ms = 0;
+		long long calls = 0;
+	};
+
+	class FitReport
+	{
+	public:
+		double fit_ms;
+		int n_iter;
+		bool converged;
+		vector<double> history;				// one convergence measure per iteration
+		map<string, PhaseStat> phases;		// SIMPLEML_PROFILE only
+		map<string, long long> counters;	// SIMPLEML_PROFILE only
+	public:
+		FitReport();
+		void reset();
+		void add_phase(const string& phase, double ms);
+		void count(const string& counter, long long n = 1);
+		void print(ostream& out = cout) const;
+	};
+
+	// called with the report so far after every iteration of an iterative fit
+	typedef function<void(const FitReport&)> FitCallback;
+
+	class ScopedTimer
+	{
+	private:
+		FitReport& report;
+		const char* phase;
+		chrono::steady_clock::time_point start;
+	public:
+		ScopedTimer(FitReport& report, const char* phase);
+		~ScopedTimer();
+	};
+
+	/*---------------------------------------------------------------------------------------*/
+
+	FitReport::FitReport() : fit_ms(0), n_iter(0), converged(false) {}
+
+	void FitReport::reset()
+	{
+		fit_ms = 0;
+		n_iter = 0;
+		converged = false;
+		history.clear();
+		phases.clear();
+		counters.clear();
+	}
+
+	void FitReport::add_phase(const string& phase, double ms)
+	{
+		PhaseStat& stat = phases[phase];
+		stat.total_ms += ms;
+		stat.calls++;
+	}
+
+	void FitReport::count(const string& counter, long long n)
+	{
+		counters[counter] += n;
+	}
+
+	void FitReport::print(ostream& out) const
+	{
+		out << "fit: " << fixed << setprecision(3) << fit_ms << "ms";
+		if (n_iter > 0)
+			out << ", " << n_iter << " iterations" << (converged ? ", converged" : ", not converged");
+		out << endl;
+		for (const auto& phase : phases) {
+			out << "  " << left << setw(24) << phase.first << right << setw(12) << phase.second.total_ms << "ms" <<
+				setw(10) << phase.second.calls << " calls" << endl;
+		}
+		for (const auto& counter : counters)
+			out << "  " << left << setw(24) << counter.first << right << setw(14) << counter.second << endl;
+		out.unsetf(std::ios::fixed);
+		out << setprecision(6);
+	}
+
+	ScopedTimer::ScopedTimer(FitReport& report, const char* phase) :
+		report(report), phase(phase), start(chrono::steady_clock::now()) {}
+
+	ScopedTimer::~ScopedTimer()
+	{
+		report.add_phase(phase, chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count());
+	}
+}
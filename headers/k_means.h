@@ -8,63 +8,172 @@
 #include <algorithm>
 #include <Eigen/Dense>
 #include "common.h"
+#include "dataset.h"
+#include "parallel.h"
+#include "instrumentation.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
 namespace SimpleML
 {
-	class KMeans
+	/*
+		Scalar is the type of the data and the centers; the center updates sum in
+		Accumulator (e.g. float data with double sums).
+	*/
+	template<class Scalar, class Accumulator>
+	class BasicGaussianMixture;
+
+	template<class Scalar, class Accumulator = Scalar>
+	class BasicKMeans
 	{
+		// GaussianMixture initializes from fit_data and make_clusters on its own data view
+		friend class BasicGaussianMixture<Scalar, Accumulator>;
 	private:
 		int K;
-		RowVectorXf* centers;
+		RowVectorT<Scalar>* centers;
+		FitReport report;
+		FitCallback callback;
 	public:
-		KMeans(int K);
-		~KMeans();
-		void fit(const MatrixXf& X, string init = "kmpp");
-		vector<vector<int>> predict(const MatrixXf& X);
-		RowVectorXf* get_centers() const;
+		BasicKMeans(int K);
+		~BasicKMeans();
+		void fit(const MatrixT<Scalar>& X, string init = "kmpp", int n_jobs = 1);
+		void fit(const MatrixT<Scalar>& X, int n_jobs);
+		void fit(const BasicDataset<Scalar>& X, string init = "kmpp", int n_jobs = 1);
+		void fit(const BasicDataset<Scalar>& X, int n_jobs);
+		void fit(const SparseRowMatrixT<Scalar>& X, string init = "kmpp", int n_jobs = 1);
+		void fit(const SparseRowMatrixT<Scalar>& X, int n_jobs);
+		vector<vector<int>> predict(const MatrixT<Scalar>& X, int n_jobs = 1);
+		vector<vector<int>> predict(const BasicDataset<Scalar>& X, int n_jobs = 1);
+		vector<vector<int>> predict(const SparseRowMatrixT<Scalar>& X, int n_jobs = 1);
+		RowVectorT<Scalar>* get_centers() const;
+		const FitReport& get_fit_report() const;
+		void set_callback(FitCallback callback);
+		void save(const string& path) const;
+		void load(const string& path);
 	private:
-		void kmpp_init_center(const MatrixXf& X);
-		void rand_init_center(const MatrixXf& X);
-		int nearest_center(const RowVectorXf& x, int n_center_initialized);
-		vector<vector<int>> make_clusters(const MatrixXf& X);
-		void update_centers(const MatrixXf& X, const vector<vector<int>>& clusters);
+		// Data is a dense expression or a SparseRowMatrixT, the kernels below are overloaded on it
+		template<class Data>
+		void fit_data(const Data& X, string init, int n_jobs);
+		template<class Data>
+		void kmpp_init_center(const Data& X, int n_jobs);
+		template<class Data>
+		void rand_init_center(const Data& X);
+		template<class Derived>
+		void nearest_centers(const MatrixBase<Derived>& X, int n_center, VectorXi& nearest, VectorT<Scalar>& distance,
+			int n_jobs);
+		void nearest_centers(const SparseRowMatrixT<Scalar>& X, int n_center, VectorXi& nearest, VectorT<Scalar>& distance,
+			int n_jobs);
+		template<int D, class Derived>
+		void nearest_centers_fixed(const MatrixBase<Derived>& X, int n_center, VectorXi& nearest,
+			VectorT<Scalar>& distance, int n_jobs);
+		template<class Data>
+		vector<vector<int>> make_clusters(const Data& X, int n_jobs);
+		template<class Derived>
+		void update_centers(const MatrixBase<Derived>& X, const vector<vector<int>>& clusters, int n_jobs);
+		void update_centers(const SparseRowMatrixT<Scalar>& X, const vector<vector<int>>& clusters, int n_jobs);
 	};
 
-	KMeans::KMeans(int K) : K(K) { centers = new RowVectorXf[K]; }
+	typedef BasicKMeans<float> KMeans;
+	typedef BasicKMeans<double> KMeansd;
+
+	/*---------------------------------------------------------------------------------------*/
+
+	template<class Scalar, class Accumulator>
+	BasicKMeans<Scalar, Accumulator>::BasicKMeans(int K) : K(K) { centers = new RowVectorT<Scalar>[K]; }
+
+	template<class Scalar, class Accumulator>
+	BasicKMeans<Scalar, Accumulator>::~BasicKMeans() { delete[] centers; }
 
-	KMeans::~KMeans() { delete[] centers; }
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::fit(const MatrixT<Scalar>& X, string init, int n_jobs) { fit_data(X, init, n_jobs); }
 
-	void KMeans::fit(const MatrixXf& X, string init)
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::fit(const BasicDataset<Scalar>& X, string init, int n_jobs)
+	{
+		fit_data(X.view(), init, n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::fit(const SparseRowMatrixT<Scalar>& X, string init, int n_jobs)
+	{
+		fit_data(X, init, n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	template<class Data>
+	void BasicKMeans<Scalar, Accumulator>::fit_data(const Data& X, string init, int n_jobs)
 	{
 		if (init != "kmpp" && init != "random") {
-			cout << "Error(KMeans::fit(const MatrixXf&, string, bool)): Invalid init option." << endl;
+			cout << "Error(BasicKMeans::fit(const MatrixT<Scalar>&, string, int)): Invalid init option." << endl;
 			exit(1);
 		}
 
+		// the history is the number of points that changed cluster in every iteration
+		report.reset();
+		auto start = chrono::steady_clock::now();
+
 		// initialize centers
-		if (init == "kmpp") {
-			kmpp_init_center(X);
-		}
-		else{
-			rand_init_center(X);
+		{
+			SIMPLEML_TIMER(report, "init");
+			if (init == "kmpp") {
+				kmpp_init_center(X, n_jobs);
+				SIMPLEML_COUNT(report, "distance_evaluations", X.rows() * (long long)K * (K - 1) / 2);
+			}
+			else {
+				rand_init_center(X);
+			}
 		}
 
 		// indices of objects in each cluster
-		vector<vector<int>> prev ;
+		vector<vector<int>> prev;
+		VectorXi prev_labels = VectorXi::Constant(X.rows(), -1);
 		while (true) {
-			vector<vector<int>> curr = make_clusters(X);
+			vector<vector<int>> curr;
+			{
+				SIMPLEML_TIMER(report, "assign");
+				curr = make_clusters(X, n_jobs);
+			}
+			SIMPLEML_COUNT(report, "distance_evaluations", X.rows() * (long long)K);
 
-			if (prev == curr)
+			int n_changed = 0;
+			for (int k = 0; k < K; k++) {
+				for (int idx : curr[k]) {
+					n_changed += prev_labels[idx] != k;
+					prev_labels[idx] = k;
+				}
+			}
+			report.n_iter++;
+			report.history.push_back(n_changed);
+			if (callback)
+				callback(report);
+
+			if (prev == curr) {
+				report.converged = true;
 				break;
+			}
 
-			update_centers(X, curr);
+			{
+				SIMPLEML_TIMER(report, "update");
+				update_centers(X, curr, n_jobs);
+			}
 			prev = curr;
 		}
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
 	}
 
-	void KMeans::kmpp_init_center(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::fit(const MatrixT<Scalar>& X, int n_jobs) { fit(X, "kmpp", n_jobs); }
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::fit(const BasicDataset<Scalar>& X, int n_jobs) { fit(X, "kmpp", n_jobs); }
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::fit(const SparseRowMatrixT<Scalar>& X, int n_jobs) { fit(X, "kmpp", n_jobs); }
+
+	template<class Scalar, class Accumulator>
+	template<class Data>
+	void BasicKMeans<Scalar, Accumulator>::kmpp_init_center(const Data& X, int n_jobs)
 	{
 		std::random_device rd;
 		std::mt19937 gen(rd());
@@ -72,28 +181,93 @@ namespace SimpleML
 		
 		// get single random center
 		centers[0] = X.row(dist(gen));
+		VectorXi nearest(X.rows());
+		VectorT<Scalar> distance(X.rows());
 		for (int i = 1; i < K; i++) {
-			vector<float> norms(X.rows());
-			for (int j = 0; j < X.rows(); j++) {
-				// calculate L2 norm from a point to its closest center
-				int idx = nearest_center(X.row(j), i);
-				norms[j] = euclidean_norm(X.row(j), centers[idx]);
-			}
-			int max = (int)std::distance(norms.begin(), std::max_element(norms.begin(), norms.end()));
+			// the point farthest from its closest center
+			nearest_centers(X, i, nearest, distance, n_jobs);
+			Index max;
+			distance.maxCoeff(&max);
 			centers[i] = X.row(max);
 		}
 	}
 
-	int KMeans::nearest_center(const RowVectorXf& x, int n_center_initialized)
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicKMeans<Scalar, Accumulator>::nearest_centers(const MatrixBase<Derived>& X, int n_center, VectorXi& nearest,
+		VectorT<Scalar>& distance, int n_jobs)
 	{
-		vector<float> norms(n_center_initialized);
-		for (int i = 0; i < n_center_initialized; i++) {
-			norms[i] = euclidean_norm(x, centers[i]);
+		// index of and squared distance to the closest of the first n_center centers, for every row
+		dispatch_dimension((int)X.cols(), [&](auto dim) {
+			nearest_centers_fixed<decltype(dim)::value>(X, n_center, nearest, distance, n_jobs);
+		});
+	}
+
+	template<class Scalar, class Accumulator>
+	template<int D, class Derived>
+	void BasicKMeans<Scalar, Accumulator>::nearest_centers_fixed(const MatrixBase<Derived>& X, int n_center,
+		VectorXi& nearest, VectorT<Scalar>& distance, int n_jobs)
+	{
+		// the centers are packed row-major, so with a compiled-in D every center is a fixed-size row
+		RowMatrixT<Scalar> packed(n_center, X.cols());
+		for (int k = 0; k < n_center; k++)
+			packed.row(k) = centers[k];
+		Map<const Matrix<Scalar, Dynamic, D, RowMajor>> C(packed.data(), n_center, X.cols());
+
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+			Matrix<Scalar, 1, D> x;
+			for (int i = begin; i < end; i++) {
+				x = X.row(i);
+				int best = 0;
+				Scalar best_distance = (C.row(0) - x).squaredNorm();
+				for (int k = 1; k < n_center; k++) {
+					Scalar d = (C.row(k) - x).squaredNorm();
+					if (d < best_distance) {
+						best = k;
+						best_distance = d;
+					}
+				}
+				nearest[i] = best;
+				distance[i] = best_distance;
+			}
+		});
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::nearest_centers(const SparseRowMatrixT<Scalar>& X, int n_center,
+		VectorXi& nearest, VectorT<Scalar>& distance, int n_jobs)
+	{
+		/*
+			|x - c|^2 = |x|^2 - 2 * x . c + |c|^2, the dot products of a block of
+			rows with every center are one sparse * dense product, O(nnz * n_center)
+		*/
+		MatrixT<Scalar> C(X.cols(), n_center);
+		RowVectorT<Scalar> center_norms(n_center);
+		for (int k = 0; k < n_center; k++) {
+			C.col(k) = centers[k].transpose();
+			center_norms[k] = centers[k].squaredNorm();
 		}
-		return (int)std::distance(norms.begin(), std::min_element(norms.begin(), norms.end()));
+
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+			const int block_size = 1024;
+			MatrixT<Scalar> dots;
+			for (int first = begin; first < end; first += block_size) {
+				int rows = std::min(block_size, end - first);
+				dots.noalias() = X.middleRows(first, rows) * C;
+				for (int i = 0; i < rows; i++) {
+					Scalar x_norm = X.row(first + i).squaredNorm();
+					Index best;
+					Scalar best_distance = (center_norms - 2 * dots.row(i)).minCoeff(&best) + x_norm;
+					nearest[first + i] = (int)best;
+					distance[first + i] = std::max(best_distance, (Scalar)0);
+				}
+			}
+		});
 	}
 
-	void KMeans::rand_init_center(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	template<class Data>
+	void BasicKMeans<Scalar, Accumulator>::rand_init_center(const Data& X)
 	{
 		vector<int> rand_num = generate_random_index((int)X.rows());
 
@@ -103,36 +277,116 @@ namespace SimpleML
 		}
 	}
 
-	vector<vector<int>> KMeans::make_clusters(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	template<class Data>
+	vector<vector<int>> BasicKMeans<Scalar, Accumulator>::make_clusters(const Data& X, int n_jobs)
 	{
+		// labels are found in parallel, the clusters are filled in row order as before
+		VectorXi nearest(X.rows());
+		VectorT<Scalar> distance(X.rows());
+		nearest_centers(X, K, nearest, distance, n_jobs);
+
 		vector<vector<int>> clusters(K);
 		for (int i = 0; i < X.rows(); i++) {
-			int idx = nearest_center(X.row(i), K);
-			clusters[idx].push_back(i);
+			clusters[nearest[i]].push_back(i);
 		}
 		return clusters;
 	}
 
-	void KMeans::update_centers(const MatrixXf& X, const vector<vector<int>>& clusters)
+	template<class Scalar, class Accumulator>
+	template<class Derived>
+	void BasicKMeans<Scalar, Accumulator>::update_centers(const MatrixBase<Derived>& X, const vector<vector<int>>& clusters, int n_jobs)
+	{
+		parallel_for(0, (int)clusters.size(), n_jobs, [&](int begin, int end, int /*job*/) {
+			for (int i = begin; i < end; i++) {
+				RowVectorT<Accumulator> sum = RowVectorT<Accumulator>::Zero(X.cols());
+				for (int j = 0; j < clusters[i].size(); j++) {
+					sum += X.row(clusters[i][j]).template cast<Accumulator>();
+				}
+				centers[i] = (sum / (Accumulator)clusters[i].size()).template cast<Scalar>();
+			}
+		});
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::update_centers(const SparseRowMatrixT<Scalar>& X, const vector<vector<int>>& clusters,
+		int n_jobs)
 	{
-		for (int i = 0; i < clusters.size(); i++) {
-			RowVectorXf sum = RowVectorXf::Zero(X.cols());
-			for (int j = 0; j < clusters[i].size(); j++) {
-				sum += X.row(clusters[i][j]);
+		// only the non-zeros of every member are added to the dense sum
+		parallel_for(0, (int)clusters.size(), n_jobs, [&](int begin, int end, int /*job*/) {
+			for (int i = begin; i < end; i++) {
+				RowVectorT<Accumulator> sum = RowVectorT<Accumulator>::Zero(X.cols());
+				for (int idx : clusters[i]) {
+					for (typename SparseRowMatrixT<Scalar>::InnerIterator it(X, idx); it; ++it)
+						sum[it.col()] += (Accumulator)it.value();
+				}
+				centers[i] = (sum / (Accumulator)clusters[i].size()).template cast<Scalar>();
 			}
-			centers[i] = sum / (float)clusters[i].size();
+		});
+	}
+
+	template<class Scalar, class Accumulator>
+	vector<vector<int>> BasicKMeans<Scalar, Accumulator>::predict(const MatrixT<Scalar>& X, int n_jobs)
+	{
+		return make_clusters(X, n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	vector<vector<int>> BasicKMeans<Scalar, Accumulator>::predict(const BasicDataset<Scalar>& X, int n_jobs)
+	{
+		return make_clusters(X.view(), n_jobs);
+	}
+
+	template<class Scalar, class Accumulator>
+	vector<vector<int>> BasicKMeans<Scalar, Accumulator>::predict(const SparseRowMatrixT<Scalar>& X, int n_jobs)
+	{
+		if (X.cols() != centers[0].size()) {
+			cout << "Error(BasicKMeans::predict(const SparseRowMatrixT<Scalar>&, int)): Invalid matrix size." << endl;
+			exit(1);
 		}
+		return make_clusters(X, n_jobs);
 	}
 
-	vector<vector<int>> KMeans::predict(const MatrixXf& X)
+	template<class Scalar, class Accumulator>
+	RowVectorT<Scalar>* BasicKMeans<Scalar, Accumulator>::get_centers() const { return centers; }
+
+	template<class Scalar, class Accumulator>
+	const FitReport& BasicKMeans<Scalar, Accumulator>::get_fit_report() const { return report; }
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::set_callback(FitCallback callback) { this->callback = callback; }
+
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::save(const string& path) const
 	{
-		vector<vector<int>> clusters(K);
-		for (int i = 0; i < X.rows(); i++) {
-			int idx = nearest_center(X.row(i), K);
-			clusters[idx].push_back(i);
+		if (centers[0].size() == 0) {
+			cout << "Error(BasicKMeans::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
 		}
-		return clusters;
+		MatrixT<Scalar> packed(K, centers[0].size());
+		for (int i = 0; i < K; i++)
+			packed.row(i) = centers[i];
+		ModelWriter writer(path, "KMeans", 1);
+		writer.write_int(K);
+		writer.write_array(packed);
+		writer.close();
 	}
 
-	RowVectorXf* KMeans::get_centers() const { return centers; }
+	template<class Scalar, class Accumulator>
+	void BasicKMeans<Scalar, Accumulator>::load(const string& path)
+	{
+		ModelReader reader(path, "KMeans", 1);
+		int n_center = (int)reader.read_int();
+		MatrixT<Scalar> packed;
+		reader.read_matrix(packed);
+		if (packed.rows() != n_center) {
+			cout << "Error(BasicKMeans::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
+		delete[] centers;
+		K = n_center;
+		centers = new RowVectorT<Scalar>[K];
+		for (int i = 0; i < K; i++)
+			centers[i] = packed.row(i);
+	}
 }
\ No newline at end of file
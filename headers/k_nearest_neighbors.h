@@ -1,68 +1,303 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <string>
+#include <memory>
 #include <cmath>
 #include <numeric>
 #include <algorithm>
 #include <Eigen/Dense>
+#include "common.h"
+#include "dataset.h"
+#include "parallel.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
 namespace SimpleML
 {
-	class KNN
+	// Scalar is the type of the stored features and the distances
+	template<class Scalar>
+	class BasicKNN
 	{
 	private:
 		int K;
 		int n_class;
-		MatrixXf features;
+		RowMatrixT<Scalar> features;
 		VectorXi labels;
+		// features and labels, or the arrays of a loaded file (zero-copy)
+		Map<const RowMatrixT<Scalar>> reference;
+		Map<const VectorXi> reference_labels;
+		shared_ptr<MappedFile> mapping;
+		// sparse fit: the rows stored by column (an inverted index), their squared norms
+		// and the row indices in increasing order of norm
+		SparseMatrix<Scalar> sparse_reference;
+		VectorT<Scalar> reference_norms;
+		vector<int> norm_order;
 	public:
-		KNN(int K);
-		void fit(const MatrixXf& X, const VectorXi& Y);
-		VectorXi predict(const MatrixXf& X);
+		BasicKNN(int K);
+		BasicKNN(const BasicKNN& other);
+		BasicKNN& operator=(const BasicKNN& other);
+		void fit(const MatrixT<Scalar>& X, const VectorXi& Y);
+		void fit(const BasicDataset<Scalar>& X, const VectorXi& Y);
+		void fit(const SparseRowMatrixT<Scalar>& X, const VectorXi& Y);
+		VectorXi predict(const MatrixT<Scalar>& X, int n_jobs = 1);
+		VectorXi predict(const BasicDataset<Scalar>& X, int n_jobs = 1);
+		VectorXi predict(const SparseRowMatrixT<Scalar>& X, int n_jobs = 1);
+		void save(const string& path) const;
+		void load(const string& path);
 	private:
-		vector<float> calculate_euclidean_norms(const RowVectorXf& xt);
-		vector<int> select_K_neighbors(const vector<float>& norms);
+		void bind(const Scalar* data, Index rows, Index cols, const int* label_data, Index n_label);
+		template<class Derived>
+		void fit_data(const MatrixBase<Derived>& X, const VectorXi& Y);
+		template<class Derived>
+		VectorXi predict_data(const MatrixBase<Derived>& X, int n_jobs);
+		template<int D, class Derived>
+		void predict_rows(const MatrixBase<Derived>& X, VectorXi& predicted, int n_jobs);
+		vector<int> select_K_neighbors(const vector<Scalar>& norms);
+		vector<int> select_K_neighbors(vector<std::pair<Scalar, int>>& candidates);
 		int select_most_frequent(const vector<int>& frequencies);
 	};
 
-	KNN::KNN(int K) : K(K), n_class(0)
+	typedef BasicKNN<float> KNN;
+	typedef BasicKNN<double> KNNd;
+
+	/*---------------------------------------------------------------------------------------*/
+
+	template<class Scalar>
+	BasicKNN<Scalar>::BasicKNN(int K) : K(K), n_class(0), reference(nullptr, 0, 0), reference_labels(nullptr, 0)
 	{
 		if (K <= 0) {
-			cout << "Error(KNN(int): Invalid neighbor size." << endl;
+			cout << "Error(BasicKNN(int)): Invalid neighbor size." << endl;
 			exit(1);
 		}
 	}
 
-	void KNN::fit(const MatrixXf& X, const VectorXi& Y)
+	template<class Scalar>
+	void BasicKNN<Scalar>::fit(const MatrixT<Scalar>& X, const VectorXi& Y) { fit_data(X, Y); }
+
+	template<class Scalar>
+	void BasicKNN<Scalar>::fit(const BasicDataset<Scalar>& X, const VectorXi& Y) { fit_data(X.view(), Y); }
+
+	template<class Scalar>
+	template<class Derived>
+	void BasicKNN<Scalar>::fit_data(const MatrixBase<Derived>& X, const VectorXi& Y)
 	{
 		features = X;
 		labels = Y;
+		mapping.reset();
+		sparse_reference.resize(0, 0);
+		reference_norms.resize(0);
+		norm_order.clear();
+		bind(features.data(), features.rows(), features.cols(), labels.data(), labels.size());
 		n_class = *std::max_element(Y.data(), Y.data() + Y.size()) + 1;
 	}
 
-	VectorXi KNN::predict(const MatrixXf& X)
+	template<class Scalar>
+	void BasicKNN<Scalar>::fit(const SparseRowMatrixT<Scalar>& X, const VectorXi& Y)
 	{
-		VectorXi predicted(X.rows());
-		for (int i = 0; i < X.rows(); i++) {
-			vector<float> norms = calculate_euclidean_norms(X.row(i));
-			vector<int> freqs = select_K_neighbors(norms);
-			predicted[i] = select_most_frequent(freqs);
+		// no dense reference rows, predict takes sparse queries only
+		if (X.rows() != Y.size()) {
+			cout << "Error(BasicKNN::fit(const SparseRowMatrixT<Scalar>&, const VectorXi&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		features.resize(0, 0);
+		labels = Y;
+		mapping.reset();
+		sparse_reference = X;
+		reference_norms.resize(X.rows());
+		for (int j = 0; j < X.rows(); j++)
+			reference_norms[j] = X.row(j).squaredNorm();
+		norm_order.resize(X.rows());
+		std::iota(norm_order.begin(), norm_order.end(), 0);
+		std::stable_sort(norm_order.begin(), norm_order.end(),
+			[&](int i, int j) { return reference_norms[i] < reference_norms[j]; });
+		bind(features.data(), 0, 0, labels.data(), labels.size());
+		n_class = *std::max_element(Y.data(), Y.data() + Y.size()) + 1;
+	}
+
+	template<class Scalar>
+	BasicKNN<Scalar>::BasicKNN(const BasicKNN& other) : reference(nullptr, 0, 0), reference_labels(nullptr, 0)
+	{
+		*this = other;
+	}
+
+	template<class Scalar>
+	BasicKNN<Scalar>& BasicKNN<Scalar>::operator=(const BasicKNN& other)
+	{
+		// a loaded copy shares the mapping, a fitted one points at its own arrays
+		if (this == &other)
+			return *this;
+		K = other.K;
+		n_class = other.n_class;
+		features = other.features;
+		labels = other.labels;
+		mapping = other.mapping;
+		sparse_reference = other.sparse_reference;
+		reference_norms = other.reference_norms;
+		norm_order = other.norm_order;
+		if (mapping)
+			bind(other.reference.data(), other.reference.rows(), other.reference.cols(), other.reference_labels.data(),
+				other.reference_labels.size());
+		else
+			bind(features.data(), features.rows(), features.cols(), labels.data(), labels.size());
+		return *this;
+	}
+
+	template<class Scalar>
+	void BasicKNN<Scalar>::bind(const Scalar* data, Index rows, Index cols, const int* label_data, Index n_label)
+	{
+		// a Map cannot be reassigned (operator= copies the coefficients), so it is rebuilt in place
+		new (&reference) Map<const RowMatrixT<Scalar>>(data, rows, cols);
+		new (&reference_labels) Map<const VectorXi>(label_data, n_label);
+	}
+
+	template<class Scalar>
+	void BasicKNN<Scalar>::save(const string& path) const
+	{
+		if (sparse_reference.rows() > 0) {
+			cout << "Error(BasicKNN::save(const string&)): A model fitted on sparse data cannot be saved." << endl;
+			exit(1);
+		}
+		if (reference.rows() == 0) {
+			cout << "Error(BasicKNN::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
 		}
+		ModelWriter writer(path, "KNN", 1);
+		writer.write_int(K);
+		writer.write_int(n_class);
+		writer.write_array(reference.data(), reference.rows(), reference.cols(), true);
+		writer.write_array(reference_labels.data(), reference_labels.rows(), 1, false);
+		writer.close();
+	}
+
+	template<class Scalar>
+	void BasicKNN<Scalar>::load(const string& path)
+	{
+		// the reference rows and labels stay in the mapped file
+		ModelReader reader(path, "KNN", 1);
+		K = (int)reader.read_int();
+		n_class = (int)reader.read_int();
+		Index rows, cols, n_label, one;
+		const Scalar* data = reader.read_array<Scalar>(rows, cols, true);
+		const int* label_data = reader.read_array<int>(n_label, one, false);
+		if (n_label != rows) {
+			cout << "Error(BasicKNN::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
+		features.resize(0, 0);
+		labels.resize(0);
+		sparse_reference.resize(0, 0);
+		reference_norms.resize(0);
+		norm_order.clear();
+		mapping = reader.mapping();
+		bind(data, rows, cols, label_data, n_label);
+	}
+
+	template<class Scalar>
+	VectorXi BasicKNN<Scalar>::predict(const MatrixT<Scalar>& X, int n_jobs) { return predict_data(X, n_jobs); }
+
+	template<class Scalar>
+	VectorXi BasicKNN<Scalar>::predict(const BasicDataset<Scalar>& X, int n_jobs) { return predict_data(X.view(), n_jobs); }
+
+	template<class Scalar>
+	VectorXi BasicKNN<Scalar>::predict(const SparseRowMatrixT<Scalar>& X, int n_jobs)
+	{
+		/*
+			|x - f|^2 = |x|^2 + |f|^2 - 2 * x . f, where x . f is accumulated from
+			the inverted index: every non-zero x_c visits only the stored rows that
+			are non-zero in column c. A row it never visits has x . f = 0, so of
+			those only the first K in norm_order can be among the K nearest. The
+			work per query is the overlapping non-zeros plus K, not the stored rows.
+		*/
+		if (sparse_reference.rows() == 0 || X.cols() != sparse_reference.cols()) {
+			cout << "Error(BasicKNN::predict(const SparseRowMatrixT<Scalar>&, int)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		VectorXi predicted(X.rows());
+		int n_reference = (int)sparse_reference.rows();
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+			// dots and visited are all zero between queries, only the touched rows are reset
+			vector<Scalar> dots(n_reference);
+			vector<char> visited(n_reference);
+			vector<int> touched;
+			vector<std::pair<Scalar, int>> candidates;
+			for (int i = begin; i < end; i++) {
+				Scalar query_norm = 0;
+				for (typename SparseRowMatrixT<Scalar>::InnerIterator x(X, i); x; ++x) {
+					query_norm += x.value() * x.value();
+					for (typename SparseMatrix<Scalar>::InnerIterator f(sparse_reference, x.col()); f; ++f) {
+						if (!visited[f.row()]) {
+							visited[f.row()] = 1;
+							touched.push_back((int)f.row());
+						}
+						dots[f.row()] += x.value() * f.value();
+					}
+				}
+
+				candidates.clear();
+				for (int j : touched)
+					candidates.emplace_back(std::sqrt(std::max(query_norm + reference_norms[j] - 2 * dots[j], (Scalar)0)), j);
+				int n_untouched = 0;
+				for (int k = 0; k < n_reference && n_untouched < K; k++) {
+					int j = norm_order[k];
+					if (!visited[j]) {
+						candidates.emplace_back(std::sqrt(query_norm + reference_norms[j]), j);
+						n_untouched++;
+					}
+				}
+
+				vector<int> freqs = select_K_neighbors(candidates);
+				predicted[i] = select_most_frequent(freqs);
+
+				for (int j : touched) {
+					dots[j] = 0;
+					visited[j] = 0;
+				}
+				touched.clear();
+			}
+		});
 		return predicted;
 	}
 
-	vector<float> KNN::calculate_euclidean_norms(const RowVectorXf& xt)
+	template<class Scalar>
+	template<class Derived>
+	VectorXi BasicKNN<Scalar>::predict_data(const MatrixBase<Derived>& X, int n_jobs)
 	{
-		vector<float> norms(features.rows());
-		for (int i = 0; i < features.rows(); i++) {
-			norms[i] = (features.row(i) - xt).norm();
+		if (X.cols() != reference.cols()) {
+			cout << "Error(BasicKNN::predict(const MatrixT<Scalar>&, int)): Invalid matrix size." << endl;
+			exit(1);
 		}
-		return norms;
+		VectorXi predicted(X.rows());
+		dispatch_dimension((int)X.cols(), [&](auto dim) {
+			predict_rows<decltype(dim)::value>(X, predicted, n_jobs);
+		});
+		return predicted;
+	}
+
+	template<class Scalar>
+	template<int D, class Derived>
+	void BasicKNN<Scalar>::predict_rows(const MatrixBase<Derived>& X, VectorXi& predicted, int n_jobs)
+	{
+		// query rows are independent, every job answers its own range of them;
+		// with a compiled-in D every stored row is a fixed-size, contiguous row
+		Map<const Matrix<Scalar, Dynamic, D, RowMajor>> F(reference.data(), reference.rows(), reference.cols());
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+			Matrix<Scalar, 1, D> xt;
+			vector<Scalar> norms(F.rows());
+			for (int i = begin; i < end; i++) {
+				xt = X.row(i);
+				for (int j = 0; j < F.rows(); j++) {
+					norms[j] = (F.row(j) - xt).norm();
+				}
+				vector<int> freqs = select_K_neighbors(norms);
+				predicted[i] = select_most_frequent(freqs);
+			}
+		});
 	}
 
-	vector<int> KNN::select_K_neighbors(const vector<float>& norms)
+	template<class Scalar>
+	vector<int> BasicKNN<Scalar>::select_K_neighbors(const vector<Scalar>& norms)
 	{
 		// argsort
 		vector<int> indicies(norms.size());
@@ -73,14 +308,31 @@ namespace SimpleML
 		// select K neighbors
 		vector<int> neighbors(n_class);
 		for (int i = 0; i < K; i++) {
-			int label = labels[indicies[i]];
+			int label = reference_labels[indicies[i]];
+			neighbors[label]++;
+		}
+
+		return neighbors;
+	}
+
+	template<class Scalar>
+	vector<int> BasicKNN<Scalar>::select_K_neighbors(vector<std::pair<Scalar, int>>& candidates)
+	{
+		// the K smallest (distance, row) pairs; ties go to the lower row as in the stable argsort
+		int n_neighbor = std::min(K, (int)candidates.size());
+		std::partial_sort(candidates.begin(), candidates.begin() + n_neighbor, candidates.end());
+
+		vector<int> neighbors(n_class);
+		for (int i = 0; i < n_neighbor; i++) {
+			int label = reference_labels[candidates[i].second];
 			neighbors[label]++;
 		}
 
 		return neighbors;
 	}
 
-	int KNN::select_most_frequent(const vector<int>& frequencies)
+	template<class Scalar>
+	int BasicKNN<Scalar>::select_most_frequent(const vector<int>& frequencies)
 	{
 		return (int)std::distance(frequencies.begin(),
 			std::max_element(frequencies.begin(), frequencies.end()));
@@ -0,0 +1,207 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <Eigen/Dense>
+using namespace std;
+using namespace Eigen;
+
+namespace SimpleML
+{
+	// batch rows -> one output row per input row; called from several workers at once
+	typedef function<MatrixXf(const MatrixXf&)> BatchPredictor;
+
+	// receives the output row of one request, on the worker that ran its batch
+	typedef function<void(const float* output, int n_output)> ReplyCallback;
+
+	struct BatchWindowStats
+	{
+		long long requests = 0;
+		long long batches = 0;
+		double seconds = 0;
+		vector<double> latencies_us;	// arrival to reply, one per request
+		double percentile(double q) const;
+		double mean_batch() const;
+		double throughput() const;
+	};
+
+	class MicroBatcher
+	{
+		/*
+			Coalesces single-row requests into batches for one predict call. A
+			batch is dispatched when it holds max_batch rows, when its oldest
+			request has waited max_delay, or at once when no other batch is
+			running: an idle batcher adds no latency, and batches grow with the
+			load while the workers are busy.
+		*/
+	private:
+		struct Request
+		{
+			vector<float> row;
+			ReplyCallback reply;
+			chrono::steady_clock::time_point arrival;
+		};
+		int n_features;
+		BatchPredictor predictor;
+		int max_batch;
+		chrono::microseconds max_delay;
+		mutex lock;
+		condition_variable cv;
+		deque<Request> queue;
+		int busy;
+		bool stop;
+		vector<thread> workers;
+		mutex stats_lock;
+		BatchWindowStats window;
+		chrono::steady_clock::time_point window_start;
+	public:
+		MicroBatcher(int n_features, BatchPredictor predictor, int max_batch = 64, int max_delay_us = 1000,
+			int n_workers = 1);
+		~MicroBatcher();
+		void submit(const float* row, ReplyCallback reply);
+		BatchWindowStats take_stats();
+		void shutdown();
+	private:
+		void worker_loop();
+		void run_batch(vector<Request>& batch);
+	};
+
+	/*---------------------------------------------------------------------------------------*/
+
+	double BatchWindowStats::percentile(double q) const
+	{
+		// q in [0, 1], nearest rank
+		if (latencies_us.empty())
+			return 0;
+		vector<double> sorted = latencies_us;
+		size_t rank = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+		return sorted[rank];
+	}
+
+	double BatchWindowStats::mean_batch() const { return batches > 0 ? (double)requests / batches : 0; }
+
+	double BatchWindowStats::throughput() const { return seconds > 0 ? requests / seconds : 0; }
+
+	MicroBatcher::MicroBatcher(int n_features, BatchPredictor predictor, int max_batch, int max_delay_us, int n_workers) :
+		n_features(n_features), predictor(predictor), max_batch(max_batch), max_delay(max_delay_us),
+		busy(0), stop(false), window_start(chrono::steady_clock::now())
+	{
+		if (n_features < 1 || max_batch < 1 || max_delay_us < 0 || n_workers < 1) {
+			cout << "Error(MicroBatcher(int, BatchPredictor, int, int, int)): Invalid argument." << endl;
+			exit(1);
+		}
+		for (int i = 0; i < n_workers; i++)
+			workers.emplace_back(&MicroBatcher::worker_loop, this);
+	}
+
+	MicroBatcher::~MicroBatcher() { shutdown(); }
+
+	void MicroBatcher::submit(const float* row, ReplyCallback reply)
+	{
+		{
+			unique_lock<mutex> guard(lock);
+			if (stop)
+				return;
+			queue.push_back(Request{ vector<float>(row, row + n_features), std::move(reply), chrono::steady_clock::now() });
+		}
+		cv.notify_one();
+	}
+
+	void MicroBatcher::shutdown()
+	{
+		// the queued requests are still answered
+		{
+			unique_lock<mutex> guard(lock);
+			if (stop)
+				return;
+			stop = true;
+		}
+		cv.notify_all();
+		for (thread& worker : workers)
+			worker.join();
+	}
+
+	BatchWindowStats MicroBatcher::take_stats()
+	{
+		// the stats since the previous call
+		unique_lock<mutex> guard(stats_lock);
+		auto now = chrono::steady_clock::now();
+		BatchWindowStats stats = std::move(window);
+		stats.seconds = chrono::duration<double>(now - window_start).count();
+		window = BatchWindowStats();
+		window_start = now;
+		return stats;
+	}
+
+	void MicroBatcher::worker_loop()
+	{
+		vector<Request> batch;
+		while (true) {
+			{
+				unique_lock<mutex> guard(lock);
+				cv.wait(guard, [&]() { return stop || !queue.empty(); });
+				if (queue.empty())
+					return;
+
+				// wait for a fuller batch only while another batch is running
+				while (!stop && !queue.empty() && busy > 0 && (int)queue.size() < max_batch) {
+					auto deadline = queue.front().arrival + max_delay;
+					if (cv.wait_until(guard, deadline) == cv_status::timeout)
+						break;
+				}
+				if (queue.empty())
+					continue;
+
+				int size = std::min(max_batch, (int)queue.size());
+				for (int i = 0; i < size; i++) {
+					batch.push_back(std::move(queue.front()));
+					queue.pop_front();
+				}
+				busy++;
+			}
+			cv.notify_all();
+
+			run_batch(batch);
+			batch.clear();
+			{
+				unique_lock<mutex> guard(lock);
+				busy--;
+			}
+			cv.notify_all();
+		}
+	}
+
+	void MicroBatcher::run_batch(vector<Request>& batch)
+	{
+		int size = (int)batch.size();
+		MatrixXf X(size, n_features);
+		for (int i = 0; i < size; i++)
+			X.row(i) = Map<const RowVectorXf>(batch[i].row.data(), n_features);
+
+		MatrixXf Y = predictor(X);
+		if (Y.rows() != size) {
+			cout << "Error(MicroBatcher::run_batch(vector<Request>&)): The predictor must return one row per input row." << endl;
+			exit(1);
+		}
+
+		// row-major, so that every reply is one contiguous row
+		Matrix<float, Dynamic, Dynamic, RowMajor> outputs = Y;
+		vector<double> latencies(size);
+		for (int i = 0; i < size; i++) {
+			batch[i].reply(outputs.row(i).data(), (int)outputs.cols());
+			latencies[i] = chrono::duration<double, std::micro>(chrono::steady_clock::now() - batch[i].arrival).count();
+		}
+
+		unique_lock<mutex> guard(stats_lock);
+		window.requests += size;
+		window.batches++;
+		window.latencies_us.insert(window.latencies_us.end(), latencies.begin(), latencies.end());
+	}
+}
@@ -1,21 +1,67 @@
 #pragma once
+#include <iostream>
 #include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
 #include <random>
 #include <chrono>
 #include <numeric>
 #include <limits>
+#include <type_traits>
 #include <Eigen/Dense>
 #include "common.h"
+#include "parallel.h"
 using namespace std;
 using namespace Eigen;
 
 namespace SimpleML
 {
+	struct CrossValidationResult
+	{
+		// one entry per split, in the order of the splits; times are in milliseconds
+		vector<float> accuracies;
+		vector<double> fit_times;
+		vector<double> predict_times;
+		float mean_accuracy() const;
+		float std_accuracy() const;
+	};
+
+	template<class T>
+	float evaluate_classification_model(T& model, const MatrixXf& X, const VectorXi& Y, int n_fold, int n_jobs = 1);
+
 	template<class T>
-	float evaluate_classification_model(T& model, const MatrixXf& X, const VectorXi& Y, int n_fold);
+	CrossValidationResult evaluate_classification_model(T& model, const MatrixXf& X, const VectorXi& Y,
+		const vector<vector<int>>& test_sets, int n_jobs = 1);
+
+	template<class T>
+	void run_splits(T& model, const MatrixXf& X, const VectorXi& Y, const vector<vector<int>>& test_sets,
+		int begin, int end, CrossValidationResult& result);
 
 	vector<vector<int>> split_to_folds(const MatrixXf& X, int n_fold);
 
+	vector<vector<int>> k_fold(int n_sample, int n_fold, unsigned seed);
+
+	vector<vector<int>> stratified_k_fold(const VectorXi& Y, int n_fold, unsigned seed);
+
+	vector<vector<int>> repeated_k_fold(int n_sample, int n_fold, int n_repeat, unsigned seed);
+
+	vector<vector<int>> repeated_stratified_k_fold(const VectorXi& Y, int n_fold, int n_repeat, unsigned seed);
+
+	vector<vector<int>> shuffle_split(int n_sample, int n_split, float test_ratio, unsigned seed);
+
+	void append_k_fold(vector<int>& order, int n_fold, std::mt19937& gen, vector<vector<int>>& folds);
+
+	void shuffle_indices(vector<int>& indices, std::mt19937& gen);
+
+	vector<int> complement_indices(int n_sample, const vector<int>& indices);
+
+	vector<int> train_indices(const vector<vector<int>>& folds, int except);
+
+	void gather_rows(const MatrixXf& X, const vector<int>& indices, MatrixXf& out);
+
+	void gather_rows(const VectorXi& Y, const vector<int>& indices, VectorXi& out);
+
 	MatrixXf train_feature(const MatrixXf& X, const vector<vector<int>>& folds, int except);
 
 	VectorXi train_label(const VectorXi& Y, const vector<vector<int>>& folds, int except);
@@ -27,101 +73,314 @@ namespace SimpleML
 	float calc_accuracy(const VectorXi& actual, const VectorXi& predicted);
 
 	template<class T>
-	float evaluate_clustering_model(T& model, const MatrixXf& X);
+	float evaluate_clustering_model(T& model, const MatrixXf& X, int n_jobs = 1);
+
+	float silhouette_score(const MatrixXf& X, const vector<vector<int>>& clusters,
+		int sample_size = 0, int n_jobs = 1);
 
-	float silhouette_score(const MatrixXf& X, const vector<vector<int>>& clusters);
+	MatrixXd cluster_distance_sums(const MatrixXd& X, const VectorXi& labels, int n_cluster,
+		const vector<int>& rows, int n_jobs);
 
 	float mean_distance(const RowVectorXf& p, const MatrixXf& X, const vector<int>& cluster);
 
+	float CrossValidationResult::mean_accuracy() const
+	{
+		if (accuracies.empty())
+			return 0;
+		return std::accumulate(accuracies.begin(), accuracies.end(), 0.f) / accuracies.size();
+	}
+
+	float CrossValidationResult::std_accuracy() const
+	{
+		if (accuracies.empty())
+			return 0;
+		float mean = mean_accuracy();
+		float sum = 0;
+		for (float accuracy : accuracies)
+			sum += (accuracy - mean) * (accuracy - mean);
+		return std::sqrt(sum / accuracies.size());
+	}
+
 	template<class T>
-	float evaluate_classification_model(T& model, const MatrixXf& X, const VectorXi& Y, int n_fold)
+	float evaluate_classification_model(T& model, const MatrixXf& X, const VectorXi& Y, int n_fold, int n_jobs)
 	{
-		vector<vector<int>> folds = split_to_folds(X, n_fold);
+		return evaluate_classification_model(model, X, Y, split_to_folds(X, n_fold), n_jobs).mean_accuracy();
+	}
 
-		float accuracy = 0;
-		for (int i = 0; i < n_fold; i++) {
-			model.fit(train_feature(X, folds, i), train_label(Y, folds, i));
+	template<class T>
+	CrossValidationResult evaluate_classification_model(T& model, const MatrixXf& X, const VectorXi& Y,
+		const vector<vector<int>>& test_sets, int n_jobs)
+	{
+		/*
+			test_sets comes from k_fold, stratified_k_fold, repeated_k_fold,
+			shuffle_split, ...; each split trains on every row outside its test set.
+			n_jobs == 1 fits the given model on every split in turn (it ends up
+			fitted on the last one). Otherwise splits run concurrently, and each job
+			trains its own copy of the model, which is left untouched. Concurrent
+			splits share memory bandwidth, so their timings are not comparable with
+			n_jobs == 1 timings.
+		*/
+		if (X.rows() != Y.size()) {
+			cout << "Error(evaluate_classification_model(T&, const MatrixXf&, const VectorXi&, ";
+			cout << "const vector<vector<int>>&, int)): Invalid matrix size." << endl;
+			exit(1);
+		}
+
+		int n_split = (int)test_sets.size();
+		CrossValidationResult result;
+		result.accuracies.resize(n_split);
+		result.fit_times.resize(n_split);
+		result.predict_times.resize(n_split);
+		if (n_split == 0)
+			return result;
+
+		if constexpr (!std::is_copy_constructible<T>::value)
+			n_jobs = 1;
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), n_split));
 
-			VectorXi predicted = model.predict(test_feature(X, folds, i));
-			accuracy += calc_accuracy(test_label(Y, folds, i), predicted);
+		if (n_jobs == 1) {
+			run_splits(model, X, Y, test_sets, 0, n_split, result);
+		}
+		else if constexpr (std::is_copy_constructible<T>::value) {
+			parallel_for(0, n_split, n_jobs, [&](int begin, int end, int job) {
+				T local = model;
+				run_splits(local, X, Y, test_sets, begin, end, result);
+			});
+		}
+		return result;
+	}
+
+	template<class T>
+	void run_splits(T& model, const MatrixXf& X, const VectorXi& Y, const vector<vector<int>>& test_sets,
+		int begin, int end, CrossValidationResult& result)
+	{
+		// the gather buffers are reused by every split of this job
+		MatrixXf X_train, X_test;
+		VectorXi Y_train, Y_test;
+		for (int i = begin; i < end; i++) {
+			vector<int> train = complement_indices((int)X.rows(), test_sets[i]);
+			gather_rows(X, train, X_train);
+			gather_rows(Y, train, Y_train);
+			gather_rows(X, test_sets[i], X_test);
+			gather_rows(Y, test_sets[i], Y_test);
+
+			auto start = std::chrono::steady_clock::now();
+			model.fit(X_train, Y_train);
+			auto mid = std::chrono::steady_clock::now();
+			VectorXi predicted = model.predict(X_test);
+			auto last = std::chrono::steady_clock::now();
+
+			result.accuracies[i] = calc_accuracy(Y_test, predicted);
+			result.fit_times[i] = std::chrono::duration<double, std::milli>(mid - start).count();
+			result.predict_times[i] = std::chrono::duration<double, std::milli>(last - mid).count();
 		}
-		return accuracy / n_fold;
 	}
 
 	vector<vector<int>> split_to_folds(const MatrixXf& X, int n_fold)
 	{
-		vector<int> rand_num(X.rows());
-		std::iota(rand_num.begin(), rand_num.end(), 0);
+		// unseeded k-fold; use k_fold with a fixed seed for reproducible folds
 		unsigned seed = (unsigned)std::chrono::system_clock::now().time_since_epoch().count();
-		std::shuffle(rand_num.begin(), rand_num.end(), std::default_random_engine(seed));
+		return k_fold((int)X.rows(), n_fold, seed);
+	}
 
-		int fold_size = (int)X.rows() / n_fold;
-		vector<vector<int>> folds(n_fold, vector<int>(fold_size));
-		for (int i = 0; i < n_fold; i++) {
-			for (int j = 0; j < fold_size; j++) {
-				folds[i][j] = rand_num[j + fold_size * i];
+	vector<vector<int>> k_fold(int n_sample, int n_fold, unsigned seed)
+	{
+		if (n_fold < 2 || n_fold > n_sample) {
+			cout << "Error(k_fold(int, int, unsigned)): n_fold must be in [2, n_sample]." << endl;
+			exit(1);
+		}
+		std::mt19937 gen(seed);
+		vector<int> order(n_sample);
+		std::iota(order.begin(), order.end(), 0);
+
+		vector<vector<int>> folds;
+		append_k_fold(order, n_fold, gen, folds);
+		return folds;
+	}
+
+	vector<vector<int>> stratified_k_fold(const VectorXi& Y, int n_fold, unsigned seed)
+	{
+		/*
+			Every class is spread over the folds as evenly as possible: the rows of
+			each class are shuffled, then dealt to the folds in turn, the next class
+			continuing from the fold where the previous one stopped. Class counts per
+			fold and fold sizes both differ by at most 1.
+		*/
+		int N = (int)Y.size();
+		if (n_fold < 2 || n_fold > N) {
+			cout << "Error(stratified_k_fold(const VectorXi&, int, unsigned)): n_fold must be in [2, n_sample]." << endl;
+			exit(1);
+		}
+		std::mt19937 gen(seed);
+		map<int, vector<int>> classes;
+		for (int i = 0; i < N; i++)
+			classes[Y[i]].push_back(i);
+
+		vector<vector<int>> folds(n_fold);
+		int next = 0;
+		for (auto& entry : classes) {
+			shuffle_indices(entry.second, gen);
+			for (int idx : entry.second) {
+				folds[next].push_back(idx);
+				next = (next + 1) % n_fold;
 			}
 		}
+		for (vector<int>& fold : folds)
+			std::sort(fold.begin(), fold.end());
 		return folds;
 	}
 
-	MatrixXf train_feature(const MatrixXf& X, const vector<vector<int>>& folds, int except)
+	vector<vector<int>> repeated_k_fold(int n_sample, int n_fold, int n_repeat, unsigned seed)
 	{
-		size_t row = (folds.size() - 1) * folds[0].size();
-		MatrixXf X_fold((Eigen::Index)row, X.cols());
+		// n_repeat independent shuffles, n_repeat * n_fold test sets in repeat order
+		if (n_fold < 2 || n_fold > n_sample || n_repeat < 1) {
+			cout << "Error(repeated_k_fold(int, int, int, unsigned)): Invalid n_fold or n_repeat." << endl;
+			exit(1);
+		}
+		std::mt19937 gen(seed);
+		vector<int> order(n_sample);
+		std::iota(order.begin(), order.end(), 0);
 
-		int i = 0;
-		for (int j = 0; j < folds.size(); j++) {
-			if (j == except)
-				continue;
+		vector<vector<int>> folds;
+		for (int r = 0; r < n_repeat; r++)
+			append_k_fold(order, n_fold, gen, folds);
+		return folds;
+	}
+
+	vector<vector<int>> repeated_stratified_k_fold(const VectorXi& Y, int n_fold, int n_repeat, unsigned seed)
+	{
+		if (n_repeat < 1) {
+			cout << "Error(repeated_stratified_k_fold(const VectorXi&, int, int, unsigned)): Invalid n_repeat." << endl;
+			exit(1);
+		}
+		// every repeat draws its own seed from one generator, so the whole sequence follows from seed
+		std::mt19937 gen(seed);
+		vector<vector<int>> folds;
+		for (int r = 0; r < n_repeat; r++) {
+			vector<vector<int>> repeat = stratified_k_fold(Y, n_fold, (unsigned)gen());
+			folds.insert(folds.end(), repeat.begin(), repeat.end());
+		}
+		return folds;
+	}
+
+	vector<vector<int>> shuffle_split(int n_sample, int n_split, float test_ratio, unsigned seed)
+	{
+		// n_split independent random test sets of round(test_ratio * n_sample) rows; they may overlap
+		int n_test = (int)std::lround(test_ratio * n_sample);
+		if (n_split < 1 || n_test < 1 || n_test >= n_sample) {
+			cout << "Error(shuffle_split(int, int, float, unsigned)): Invalid n_split or test_ratio." << endl;
+			exit(1);
+		}
+		std::mt19937 gen(seed);
+		vector<int> order(n_sample);
+		std::iota(order.begin(), order.end(), 0);
 
-			for (const int& idx : folds[j]) {
-				X_fold.row(i) = X.row(idx);
-				i++;
+		vector<vector<int>> test_sets(n_split);
+		for (int s = 0; s < n_split; s++) {
+			// a partial Fisher-Yates shuffle only needs to place the first n_test entries
+			for (int i = 0; i < n_test; i++) {
+				int j = i + (int)(gen() % (unsigned)(n_sample - i));
+				std::swap(order[i], order[j]);
 			}
+			test_sets[s].assign(order.begin(), order.begin() + n_test);
+			std::sort(test_sets[s].begin(), test_sets[s].end());
 		}
-		return X_fold;
+		return test_sets;
 	}
 
-	VectorXi train_label(const VectorXi& Y, const vector<vector<int>>& folds, int except)
+	void append_k_fold(vector<int>& order, int n_fold, std::mt19937& gen, vector<vector<int>>& folds)
 	{
-		size_t size = (folds.size() - 1) * folds[0].size();
-		VectorXi Y_fold((Eigen::Index)size);
+		// the first N % n_fold folds take one extra row, so every row is used
+		shuffle_indices(order, gen);
+		long long N = (long long)order.size();
+		for (int i = 0; i < n_fold; i++) {
+			int first = (int)(N * i / n_fold);
+			int last = (int)(N * (i + 1) / n_fold);
+			folds.emplace_back(order.begin() + first, order.begin() + last);
+			std::sort(folds.back().begin(), folds.back().end());
+		}
+	}
 
-		int i = 0;
-		for (int j = 0; j < folds.size(); j++) {
-			if (j == except)
-				continue;
+	void shuffle_indices(vector<int>& indices, std::mt19937& gen)
+	{
+		/*
+			Fisher-Yates on the raw mt19937 output. std::shuffle and the standard
+			distributions are implementation defined, this gives the same folds for
+			the same seed with every compiler and standard library.
+		*/
+		for (int i = (int)indices.size() - 1; i > 0; i--) {
+			int j = (int)(gen() % (unsigned)(i + 1));
+			std::swap(indices[i], indices[j]);
+		}
+	}
 
-			for (const int& idx : folds[j]) {
-				Y_fold[i] = Y[idx];
-				i++;
-			}
+	vector<int> complement_indices(int n_sample, const vector<int>& indices)
+	{
+		// rows in [0, n_sample) that are not in indices, in ascending order
+		vector<char> excluded(n_sample, 0);
+		for (int idx : indices)
+			excluded[idx] = 1;
+		vector<int> complement;
+		complement.reserve(n_sample - indices.size());
+		for (int i = 0; i < n_sample; i++) {
+			if (!excluded[i])
+				complement.push_back(i);
 		}
-		return Y_fold;
+		return complement;
 	}
 
-	MatrixXf test_feature(const MatrixXf& X, const vector<vector<int>>& folds, int include)
+	vector<int> train_indices(const vector<vector<int>>& folds, int except)
 	{
-		MatrixXf X_fold((Eigen::Index)folds[0].size(), X.cols());
+		vector<int> indices;
+		for (int j = 0; j < (int)folds.size(); j++) {
+			if (j != except)
+				indices.insert(indices.end(), folds[j].begin(), folds[j].end());
+		}
+		return indices;
+	}
+
+	void gather_rows(const MatrixXf& X, const vector<int>& indices, MatrixXf& out)
+	{
+		// resize keeps the allocation when the shape does not change
+		out.resize((Eigen::Index)indices.size(), X.cols());
+		for (int i = 0; i < (int)indices.size(); i++) {
+			out.row(i) = X.row(indices[i]);
+		}
+	}
 
-		int i = 0;
-		for (const int& idx : folds[include]) {
-			X_fold.row(i) = X.row(idx);
-			i++;
+	void gather_rows(const VectorXi& Y, const vector<int>& indices, VectorXi& out)
+	{
+		out.resize((Eigen::Index)indices.size());
+		for (int i = 0; i < (int)indices.size(); i++) {
+			out[i] = Y[indices[i]];
 		}
+	}
+
+	MatrixXf train_feature(const MatrixXf& X, const vector<vector<int>>& folds, int except)
+	{
+		MatrixXf X_fold;
+		gather_rows(X, train_indices(folds, except), X_fold);
 		return X_fold;
 	}
 
-	VectorXi test_label(const VectorXi& Y, const vector<vector<int>>& folds, int include)
+	VectorXi train_label(const VectorXi& Y, const vector<vector<int>>& folds, int except)
 	{
-		VectorXi Y_fold((Eigen::Index)folds[0].size());
+		VectorXi Y_fold;
+		gather_rows(Y, train_indices(folds, except), Y_fold);
+		return Y_fold;
+	}
 
-		int i = 0;
-		for (const int& idx : folds[include]) {
-			Y_fold[i] = Y[idx];
-			i++;
-		}
+	MatrixXf test_feature(const MatrixXf& X, const vector<vector<int>>& folds, int include)
+	{
+		MatrixXf X_fold;
+		gather_rows(X, folds[include], X_fold);
+		return X_fold;
+	}
+
+	VectorXi test_label(const VectorXi& Y, const vector<vector<int>>& folds, int include)
+	{
+		VectorXi Y_fold;
+		gather_rows(Y, folds[include], Y_fold);
 		return Y_fold;
 	}
 
@@ -137,31 +396,116 @@ namespace SimpleML
 	}
 
 	template<class T>
-	float evaluate_clustering_model(T& model, const MatrixXf& X)
-	{
-		model.fit(X);
-		vector<vector<int>> clusters = model.predict(X);
-		return silhouette_score(X, clusters);
-	}
-
-	float silhouette_score(const MatrixXf& X, const vector<vector<int>>& clusters)
-	{
-		float score = 0;
-		for (int i = 0; i < clusters.size(); i++) {
-			for (int j = 0; j < clusters[i].size(); j++) {
-				int idx = clusters[i][j];
-				float a = -1, b = -1;
-				for (int k = 0; k < clusters.size(); k++) {
-					float temp = mean_distance(X.row(idx), X, clusters[k]);
-					if (i == k)
-						a = temp;
-					else if ((b == -1) || (b > temp))
-						b = temp;
-				}
-				score += (b - a) / std::max(a, b);
+	float evaluate_clustering_model(T& model, const MatrixXf& X, int n_jobs)
+	{
+		model.fit(X, n_jobs);
+		vector<vector<int>> clusters = model.predict(X, n_jobs);
+		return silhouette_score(X, clusters, 0, n_jobs);
+	}
+
+	float silhouette_score(const MatrixXf& X, const vector<vector<int>>& clusters, int sample_size, int n_jobs)
+	{
+		/*
+			s(i) = (b - a) / max(a, b)
+			a: mean distance from x_i to its own cluster (x_i itself included)
+			b: smallest mean distance from x_i to another non-empty cluster
+			Points of singleton clusters score 0. With sample_size > 0 only that
+			many random points are scored (against every point), which gives an
+			unbiased estimate of the mean in O(sample_size * N) distances.
+		*/
+		int N = (int)X.rows();
+		int K = (int)clusters.size();
+		VectorXi labels = VectorXi::Constant(N, -1);
+		for (int k = 0; k < K; k++) {
+			for (int idx : clusters[k])
+				labels[idx] = k;
+		}
+
+		vector<int> rows;
+		if (sample_size > 0 && sample_size < N) {
+			rows = generate_random_index(N);
+			rows.resize(sample_size);
+		}
+		else {
+			rows.resize(N);
+			std::iota(rows.begin(), rows.end(), 0);
+		}
+
+		MatrixXd Xd = X.cast<double>();
+		MatrixXd sums = cluster_distance_sums(Xd, labels, K, rows, n_jobs);
+
+		double score = 0;
+		int n_scored = 0;
+		for (int r = 0; r < (int)rows.size(); r++) {
+			int own = labels[rows[r]];
+			if (own < 0)
+				continue;
+			n_scored++;
+			if (clusters[own].size() <= 1)
+				continue;
+
+			double a = sums(r, own) / clusters[own].size();
+			double b = -1;
+			for (int k = 0; k < K; k++) {
+				if (k == own || clusters[k].empty())
+					continue;
+				double mean = sums(r, k) / clusters[k].size();
+				if (b < 0 || mean < b)
+					b = mean;
 			}
+			if (b < 0 || std::max(a, b) == 0)
+				continue;
+			score += (b - a) / std::max(a, b);
 		}
-		return score / (float)X.rows();
+		return n_scored == 0 ? 0.f : (float)(score / n_scored);
+	}
+
+	MatrixXd cluster_distance_sums(const MatrixXd& X, const VectorXi& labels, int n_cluster,
+		const vector<int>& rows, int n_jobs)
+	{
+		/*
+			sums(r, k) = sum of |x_rows[r] - x_j| over the points j of cluster k.
+			Distances are built a tile at a time with |x|^2 + |y|^2 - 2 * x * yt
+			(one GEMM per tile), and a second GEMM against the one-hot cluster
+			matrix of the tile's columns folds them into per-cluster sums. Row
+			tiles are independent, so jobs split them without any reduction.
+		*/
+		const int row_block = 256, col_block = 2048;
+		int N = (int)X.rows();
+		int R = (int)rows.size();
+		VectorXd norms = X.rowwise().squaredNorm();
+		MatrixXd sums = MatrixXd::Zero(R, n_cluster);
+
+		int n_row_block = (R + row_block - 1) / row_block;
+		parallel_for(0, n_row_block, n_jobs, [&](int begin, int end, int /*job*/) {
+			MatrixXd left, dist, onehot;
+			for (int rb = begin; rb < end; rb++) {
+				int r0 = rb * row_block;
+				int r_size = std::min(row_block, R - r0);
+				left.resize(r_size, X.cols());
+				VectorXd left_norms(r_size);
+				for (int r = 0; r < r_size; r++) {
+					left.row(r) = X.row(rows[r0 + r]);
+					left_norms[r] = norms[rows[r0 + r]];
+				}
+
+				for (int c0 = 0; c0 < N; c0 += col_block) {
+					int c_size = std::min(col_block, N - c0);
+					dist.noalias() = -2. * left * X.middleRows(c0, c_size).transpose();
+					dist.colwise() += left_norms;
+					dist.rowwise() += norms.segment(c0, c_size).transpose();
+					dist = dist.cwiseMax(0.).cwiseSqrt();
+
+					onehot = MatrixXd::Zero(c_size, n_cluster);
+					for (int c = 0; c < c_size; c++) {
+						if (labels[c0 + c] >= 0)
+							onehot(c, labels[c0 + c]) = 1;
+					}
+					sums.middleRows(r0, r_size).noalias() += dist * onehot;
+				}
+			}
+		});
+		return sums;
 	}
 
 	float mean_distance(const RowVectorXf& p, const MatrixXf& X, const vector<int>& cluster)
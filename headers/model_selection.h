@@ -0,0 +1,394 @@
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "parallel.h"
+#include "model_evaluation.h"
+using namespace std;
+using namespace Eigen;
+
+namespace SimpleML
+{
+	// one configuration: parameter name -> value (integer parameters are rounded by the caller)
+	typedef map<string, float> Parameters;
+
+	struct ParameterRange
+	{
+		float low;
+		float high;
+		string scale;		// "linear" or "log" (uniform in log space, e.g. for tolerances)
+		bool integer;		// rounded to the nearest integer after sampling
+	};
+
+	struct TrialScore
+	{
+		float score;		// higher is better
+		double fit_time;	// ms
+		double score_time;	// ms
+	};
+
+	struct SearchResult
+	{
+		Parameters params;
+		int rank;			// 1 is the best configuration
+		int iteration;		// last successive halving round the configuration reached
+		int n_resource;		// training rows per split in that round
+		float mean_score;
+		float std_score;
+		double mean_fit_time;	// ms
+		double mean_score_time;	// ms
+	};
+
+	vector<Parameters> parameter_grid(const map<string, vector<float>>& grid);
+
+	vector<Parameters> sample_parameters(const map<string, ParameterRange>& space, int n_candidate, unsigned seed);
+
+	template<class F>
+	auto classification_objective(F make_model, const MatrixXf& X, const VectorXi& Y);
+
+	template<class F>
+	auto clustering_objective(F make_model, const MatrixXf& X);
+
+	template<class Objective>
+	vector<SearchResult> grid_search(Objective objective, const vector<Parameters>& candidates,
+		const vector<vector<int>>& test_sets, int n_sample, int n_jobs = 0);
+
+	template<class Objective>
+	vector<SearchResult> successive_halving(Objective objective, const vector<Parameters>& candidates,
+		const vector<vector<int>>& test_sets, int n_sample, int min_resource, int factor = 3,
+		unsigned seed = 0, int n_jobs = 0);
+
+	template<class Objective>
+	vector<SearchResult> hyperband(Objective objective, const map<string, ParameterRange>& space,
+		const vector<vector<int>>& test_sets, int n_sample, int min_resource, int factor = 3,
+		unsigned seed = 0, int n_jobs = 0);
+
+	template<class Objective>
+	vector<SearchResult> run_trials(Objective& objective, const vector<Parameters>& candidates,
+		const vector<vector<int>>& train_sets, const vector<vector<int>>& test_sets, int n_resource, int n_jobs);
+
+	void rank_results(vector<SearchResult>& results);
+
+	void print_search_results(const vector<SearchResult>& results, int n_top = 10);
+
+	/*---------------------------------------------------------------------------------------*/
+
+	vector<Parameters> parameter_grid(const map<string, vector<float>>& grid)
+	{
+		// every combination of the listed values, the last parameter varying fastest
+		vector<Parameters> candidates(1);
+		for (const auto& entry : grid) {
+			if (entry.second.empty()) {
+				cout << "Error(parameter_grid(const map<string, vector<float>>&)): ";
+				cout << "No value for " << entry.first << "." << endl;
+				exit(1);
+			}
+			vector<Parameters> expanded;
+			expanded.reserve(candidates.size() * entry.second.size());
+			for (const Parameters& params : candidates) {
+				for (float value : entry.second) {
+					expanded.push_back(params);
+					expanded.back()[entry.first] = value;
+				}
+			}
+			candidates.swap(expanded);
+		}
+		return candidates;
+	}
+
+	vector<Parameters> sample_parameters(const map<string, ParameterRange>& space, int n_candidate, unsigned seed)
+	{
+		// the raw mt19937 output is scaled by hand so a seed gives the same candidates everywhere
+		std::mt19937 gen(seed);
+		vector<Parameters> candidates(n_candidate);
+		for (Parameters& params : candidates) {
+			for (const auto& entry : space) {
+				const ParameterRange& range = entry.second;
+				if (range.high < range.low || (range.scale == "log" && range.low <= 0) ||
+					(range.scale != "linear" && range.scale != "log")) {
+					cout << "Error(sample_parameters(const map<string, ParameterRange>&, int, unsigned)): ";
+					cout << "Invalid range for " << entry.first << "." << endl;
+					exit(1);
+				}
+				double u = gen() / 4294967296.0;
+				double value;
+				if (range.scale == "log")
+					value = std::exp(std::log(range.low) + u * (std::log(range.high) - std::log(range.low)));
+				else
+					value = range.low + u * (range.high - range.low);
+				if (range.integer)
+					value = std::min((double)range.high, std::max((double)range.low, std::round(value)));
+				params[entry.first] = (float)value;
+			}
+		}
+		return candidates;
+	}
+
+	template<class F>
+	auto classification_objective(F make_model, const MatrixXf& X, const VectorXi& Y)
+	{
+		/*
+			make_model(params) returns a fresh model by value (a prvalue, so models
+			without a safe copy constructor work too). Scores are test accuracies.
+		*/
+		return [make_model, &X, &Y](const Parameters& params, const vector<int>& train, const vector<int>& test) {
+			MatrixXf X_train, X_test;
+			VectorXi Y_train, Y_test;
+			gather_rows(X, train, X_train);
+			gather_rows(Y, train, Y_train);
+			gather_rows(X, test, X_test);
+			gather_rows(Y, test, Y_test);
+
+			auto model = make_model(params);
+			auto start = std::chrono::steady_clock::now();
+			model.fit(X_train, Y_train);
+			auto mid = std::chrono::steady_clock::now();
+			VectorXi predicted = model.predict(X_test);
+			auto last = std::chrono::steady_clock::now();
+
+			TrialScore trial;
+			trial.score = calc_accuracy(Y_test, predicted);
+			trial.fit_time = std::chrono::duration<double, std::milli>(mid - start).count();
+			trial.score_time = std::chrono::duration<double, std::milli>(last - mid).count();
+			return trial;
+		};
+	}
+
+	template<class F>
+	auto clustering_objective(F make_model, const MatrixXf& X)
+	{
+		// KMeans, GaussianMixture, ...: fitted on the train rows, scored by the silhouette of the test rows
+		return [make_model, &X](const Parameters& params, const vector<int>& train, const vector<int>& test) {
+			MatrixXf X_train, X_test;
+			gather_rows(X, train, X_train);
+			gather_rows(X, test, X_test);
+
+			auto model = make_model(params);
+			auto start = std::chrono::steady_clock::now();
+			model.fit(X_train);
+			auto mid = std::chrono::steady_clock::now();
+			vector<vector<int>> clusters = model.predict(X_test);
+			float score = silhouette_score(X_test, clusters);
+			auto last = std::chrono::steady_clock::now();
+
+			TrialScore trial;
+			trial.score = score;
+			trial.fit_time = std::chrono::duration<double, std::milli>(mid - start).count();
+			trial.score_time = std::chrono::duration<double, std::milli>(last - mid).count();
+			return trial;
+		};
+	}
+
+	template<class Objective>
+	vector<SearchResult> grid_search(Objective objective, const vector<Parameters>& candidates,
+		const vector<vector<int>>& test_sets, int n_sample, int n_jobs)
+	{
+		/*
+			Exhaustive search: every (candidate, split) pair is one job on the thread
+			pool, trained on all rows outside the split's test set.
+			test_sets comes from k_fold, stratified_k_fold, shuffle_split, ...
+		*/
+		vector<vector<int>> train_sets(test_sets.size());
+		int n_resource = n_sample;
+		for (int s = 0; s < (int)test_sets.size(); s++) {
+			train_sets[s] = complement_indices(n_sample, test_sets[s]);
+			n_resource = std::min(n_resource, (int)train_sets[s].size());
+		}
+
+		vector<SearchResult> results = run_trials(objective, candidates, train_sets, test_sets, n_resource, n_jobs);
+		rank_results(results);
+		return results;
+	}
+
+	template<class Objective>
+	vector<SearchResult> successive_halving(Objective objective, const vector<Parameters>& candidates,
+		const vector<vector<int>>& test_sets, int n_sample, int min_resource, int factor,
+		unsigned seed, int n_jobs)
+	{
+		/*
+			Round r trains every surviving candidate on min_resource * factor^r rows
+			of each split's training set, then keeps the best 1 / factor of them.
+			The rounds end when one candidate is left or the full training sets are
+			used, so most candidates are only ever fitted on small subsets.
+			The subsets are prefixes of one seeded shuffle per split, so a larger
+			round always contains the rows of the smaller ones.
+			Candidates are ranked by the round they reached, then by score.
+		*/
+		if (min_resource < 1 || factor < 2 || test_sets.empty()) {
+			cout << "Error(successive_halving(Objective, const vector<Parameters>&, const vector<vector<int>>&, ";
+			cout << "int, int, int, unsigned, int)): Invalid min_resource, factor or test_sets." << endl;
+			exit(1);
+		}
+
+		std::mt19937 gen(seed);
+		vector<vector<int>> shuffled(test_sets.size());
+		int max_resource = n_sample;
+		for (int s = 0; s < (int)test_sets.size(); s++) {
+			shuffled[s] = complement_indices(n_sample, test_sets[s]);
+			shuffle_indices(shuffled[s], gen);
+			max_resource = std::min(max_resource, (int)shuffled[s].size());
+		}
+
+		vector<SearchResult> results;
+		vector<Parameters> survivors = candidates;
+		long long resource = min_resource;
+		for (int iteration = 0; !survivors.empty(); iteration++) {
+			int n_resource = (int)std::min<long long>(resource, max_resource);
+			vector<vector<int>> train_sets(shuffled.size());
+			for (int s = 0; s < (int)shuffled.size(); s++) {
+				train_sets[s].assign(shuffled[s].begin(), shuffled[s].begin() + n_resource);
+				std::sort(train_sets[s].begin(), train_sets[s].end());
+			}
+
+			vector<SearchResult> round = run_trials(objective, survivors, train_sets, test_sets, n_resource, n_jobs);
+			for (SearchResult& result : round)
+				result.iteration = iteration;
+
+			bool last_round = survivors.size() == 1 || n_resource == max_resource;
+			int n_keep = (int)std::max<size_t>(1, survivors.size() / factor);
+			vector<int> order(round.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(),
+				[&](int i, int j) { return round[i].mean_score > round[j].mean_score; });
+
+			// dropped candidates keep the result of the round they were dropped in
+			survivors.clear();
+			for (int k = 0; k < (int)order.size(); k++) {
+				if (!last_round && k < n_keep)
+					survivors.push_back(round[order[k]].params);
+				else
+					results.push_back(round[order[k]]);
+			}
+			resource *= factor;
+		}
+
+		rank_results(results);
+		return results;
+	}
+
+	template<class Objective>
+	vector<SearchResult> hyperband(Objective objective, const map<string, ParameterRange>& space,
+		const vector<vector<int>>& test_sets, int n_sample, int min_resource, int factor,
+		unsigned seed, int n_jobs)
+	{
+		/*
+			Hyperband runs successive halving brackets that trade the number of
+			sampled candidates against the rows each one starts with. With
+			R = (training rows) / min_resource and s_max = floor(log_factor(R)),
+			bracket s samples ceil((s_max + 1) / (s + 1) * factor^s) candidates and
+			starts them on R * factor^-s * min_resource rows, from the most
+			aggressive bracket (s = s_max) to plain random search (s = 0).
+		*/
+		if (min_resource < 1 || factor < 2 || test_sets.empty()) {
+			cout << "Error(hyperband(Objective, const map<string, ParameterRange>&, const vector<vector<int>>&, ";
+			cout << "int, int, int, unsigned, int)): Invalid min_resource, factor or test_sets." << endl;
+			exit(1);
+		}
+
+		int max_resource = n_sample;
+		for (const vector<int>& test : test_sets)
+			max_resource = std::min(max_resource, n_sample - (int)test.size());
+
+		int s_max = 0;
+		while ((long long)min_resource * (long long)std::pow(factor, s_max + 1) <= max_resource)
+			s_max++;
+
+		std::mt19937 gen(seed);
+		vector<SearchResult> results;
+		for (int s = s_max; s >= 0; s--) {
+			int n_candidate = (int)std::ceil((s_max + 1.0) / (s + 1.0) * std::pow(factor, s));
+			int start = std::max(min_resource, (int)(max_resource / std::pow(factor, s)));
+			vector<Parameters> candidates = sample_parameters(space, n_candidate, (unsigned)gen());
+			vector<SearchResult> bracket = successive_halving(objective, candidates, test_sets, n_sample,
+				start, factor, (unsigned)gen(), n_jobs);
+			results.insert(results.end(), bracket.begin(), bracket.end());
+		}
+
+		rank_results(results);
+		return results;
+	}
+
+	template<class Objective>
+	vector<SearchResult> run_trials(Objective& objective, const vector<Parameters>& candidates,
+		const vector<vector<int>>& train_sets, const vector<vector<int>>& test_sets, int n_resource, int n_jobs)
+	{
+		/*
+			(candidate, split) jobs are handed out one at a time from a shared
+			counter, so fast and slow candidates balance across the workers.
+		*/
+		int n_candidate = (int)candidates.size();
+		int n_split = (int)test_sets.size();
+		int n_trial = n_candidate * n_split;
+		vector<TrialScore> trials(n_trial);
+
+		atomic<int> next(0);
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), n_trial));
+		parallel_for(0, n_jobs, n_jobs, [&](int begin, int end, int job) {
+			for (int t = next++; t < n_trial; t = next++) {
+				int c = t / n_split, s = t % n_split;
+				trials[t] = objective(candidates[c], train_sets[s], test_sets[s]);
+			}
+		});
+
+		vector<SearchResult> results(n_candidate);
+		for (int c = 0; c < n_candidate; c++) {
+			SearchResult& result = results[c];
+			result.params = candidates[c];
+			result.rank = 0;
+			result.iteration = 0;
+			result.n_resource = n_resource;
+
+			double sum = 0, sum_sq = 0, fit_time = 0, score_time = 0;
+			for (int s = 0; s < n_split; s++) {
+				const TrialScore& trial = trials[c * n_split + s];
+				sum += trial.score;
+				sum_sq += (double)trial.score * trial.score;
+				fit_time += trial.fit_time;
+				score_time += trial.score_time;
+			}
+			result.mean_score = (float)(sum / n_split);
+			result.std_score = (float)std::sqrt(std::max(0., sum_sq / n_split - (sum / n_split) * (sum / n_split)));
+			result.mean_fit_time = fit_time / n_split;
+			result.mean_score_time = score_time / n_split;
+		}
+		return results;
+	}
+
+	void rank_results(vector<SearchResult>& results)
+	{
+		// more training rows first (they are the more trustworthy scores), then higher score
+		std::stable_sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
+			if (a.n_resource != b.n_resource)
+				return a.n_resource > b.n_resource;
+			return a.mean_score > b.mean_score;
+		});
+		for (int i = 0; i < (int)results.size(); i++)
+			results[i].rank = i + 1;
+	}
+
+	void print_search_results(const vector<SearchResult>& results, int n_top)
+	{
+		cout << setw(6) << "rank" << setw(10) << "score" << setw(10) << "std" << setw(10) << "rows" <<
+			setw(12) << "fit(ms)" << setw(12) << "score(ms)" << "  params" << endl;
+		for (int i = 0; i < (int)results.size() && (n_top <= 0 || i < n_top); i++) {
+			const SearchResult& result = results[i];
+			cout << setw(6) << result.rank << fixed << setprecision(4) << setw(10) << result.mean_score <<
+				setw(10) << result.std_score << setw(10) << result.n_resource << setprecision(2) <<
+				setw(12) << result.mean_fit_time << setw(12) << result.mean_score_time << " ";
+			cout.unsetf(std::ios::fixed);
+			cout << setprecision(6);
+			for (const auto& param : result.params)
+				cout << " " << param.first << "=" << param.second;
+			cout << endl;
+		}
+	}
+}
@@ -1,92 +1,604 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <string>
 #include <cmath>
+#include <chrono>
 #include <algorithm>
 #include <Eigen/Dense>
+#include "common.h"
+#include "dataset.h"
+#include "parallel.h"
+#include "instrumentation.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
 namespace SimpleML
 {
+	struct GaussianStatistics
+	{
+		/*
+			running count, mean and sum of squared deviations (M2) of one class,
+			accumulated in double. "full" keeps the lower triangle of the d x d
+			scatter matrix, otherwise only its diagonal (d x 1).
+		*/
+		bool full = true;
+		double count = 0;
+		VectorXd mean;
+		MatrixXd M2;
+		VectorXd delta;
+		void init(int d, bool is_full);
+		void merge(const GaussianStatistics& other);
+	};
+
 	class NaiveBayes
 	{
 	private:
 		int n_class;
-		RowVectorXf* mu;
-		MatrixXf* sigma;
+		string covariance;
+		vector<GaussianStatistics> stats;	// sufficient statistics of each class
 		RowVectorXf prior;
+		MatrixXf means;				// n_class x d
+		vector<MatrixXf> sigma;		// "full": d x d covariance of each class
+		MatrixXf variances;			// "diag": n_class x d
+		// factors precomputed at fit time
+		RowVectorXf log_prior;
+		RowVectorXf log_det;
+		vector<MatrixXf> chol;		// "full": lower Cholesky factor of each sigma
+		MatrixXf precisions;		// "diag": n_class x d, 1 / variance
+		FitReport report;
 	public:
-		NaiveBayes();
-		~NaiveBayes();
-		void fit(const MatrixXf& X, const VectorXi& Y);
-		VectorXi predict(const MatrixXf& X);
+		NaiveBayes(string covariance = "full");
+		void fit(const MatrixXf& X, const VectorXi& Y, int n_jobs = 1);
+		void fit(const Dataset& X, const VectorXi& Y, int n_jobs = 1);
+		void fit(const SparseRowMatrixT<float>& X, const VectorXi& Y, int n_jobs = 1);
+		void partial_fit(const MatrixXf& X, const VectorXi& Y);
+		void partial_fit(const Dataset& X, const VectorXi& Y);
+		void partial_fit(const SparseRowMatrixT<float>& X, const VectorXi& Y);
+		void merge(const NaiveBayes& other);
+		VectorXi predict(const MatrixXf& X, int n_jobs = 1);
+		VectorXi predict(const Dataset& X, int n_jobs = 1);
+		VectorXi predict(const SparseRowMatrixT<float>& X, int n_jobs = 1);
+		MatrixXf predict_log_proba(const MatrixXf& X, int n_jobs = 1);
+		MatrixXf predict_log_proba(const Dataset& X, int n_jobs = 1);
+		MatrixXf predict_log_proba(const SparseRowMatrixT<float>& X, int n_jobs = 1);
+		const FitReport& get_fit_report() const;
+		void save(const string& path) const;
+		void load(const string& path);
 	private:
-		vector<MatrixXf> split_by_class(const MatrixXf& X, const VectorXi& Y);
+		template<class Derived>
+		void fit_data(const EigenBase<Derived>& X, const VectorXi& Y, int n_jobs);
+		template<class Derived>
+		void partial_fit_data(const EigenBase<Derived>& X, const VectorXi& Y, const string& caller);
+		template<class Derived>
+		void accumulate(vector<GaussianStatistics>& local, const MatrixBase<Derived>& X, const VectorXi& Y,
+			int begin, int end) const;
+		void accumulate(vector<GaussianStatistics>& local, const SparseRowMatrixT<float>& X, const VectorXi& Y,
+			int begin, int end) const;
+		void check_sparse(const SparseRowMatrixT<float>& X, const string& caller) const;
+		template<int D, class Derived>
+		void accumulate_rows(vector<GaussianStatistics>& local, const MatrixBase<Derived>& X, const VectorXi& Y,
+			int begin, int end) const;
+		void finalize();
+		void precompute_factors();
+		template<class Derived>
+		MatrixXf joint_log_likelihood(const EigenBase<Derived>& X, int n_jobs);
+		template<class Derived>
+		void joint_log_likelihood_rows(const MatrixBase<Derived>& X, int begin, int end, MatrixXf& joint);
+		void joint_log_likelihood_rows(const SparseRowMatrixT<float>& X, int begin, int end, MatrixXf& joint);
+		VectorXi most_likely(const MatrixXf& joint) const;
+		MatrixXf normalize_log(const MatrixXf& joint) const;
 	};
 
-	NaiveBayes::NaiveBayes() : n_class(0), mu(nullptr), sigma(nullptr) {}
+	NaiveBayes::NaiveBayes(string covariance) : n_class(0), covariance(covariance)
+	{
+		if (covariance != "full" && covariance != "diag") {
+			cout << "Error(NaiveBayes(string)): Invalid covariance option." << endl;
+			exit(1);
+		}
+	}
+
+	void GaussianStatistics::init(int d, bool is_full)
+	{
+		full = is_full;
+		count = 0;
+		mean = VectorXd::Zero(d);
+		M2 = full ? MatrixXd::Zero(d, d) : MatrixXd::Zero(d, 1);
+		delta.resize(d);
+	}
+
+	void GaussianStatistics::merge(const GaussianStatistics& other)
+	{
+		// Chan et al.: M2 = M2_a + M2_b + delta * deltat * n_a * n_b / n
+		if (other.count == 0)
+			return;
+		if (count == 0) {
+			*this = other;
+			return;
+		}
+		double n = count + other.count;
+		delta = other.mean - mean;
+		double weight = count * other.count / n;
+		mean += delta * (other.count / n);
+		M2 += other.M2;
+		if (full)
+			M2.selfadjointView<Lower>().rankUpdate(delta, weight);
+		else
+			M2.col(0) += delta.cwiseAbs2() * weight;
+		count = n;
+	}
+
+	void NaiveBayes::fit(const MatrixXf& X, const VectorXi& Y, int n_jobs) { fit_data(X, Y, n_jobs); }
 
-	NaiveBayes::~NaiveBayes()
+	void NaiveBayes::fit(const Dataset& X, const VectorXi& Y, int n_jobs) { fit_data(X.view(), Y, n_jobs); }
+
+	void NaiveBayes::fit(const SparseRowMatrixT<float>& X, const VectorXi& Y, int n_jobs)
 	{
-		delete[] mu;
-		delete[] sigma;
+		// a refit may change d
+		stats.clear();
+		check_sparse(X, "fit(const SparseRowMatrixT<float>&, const VectorXi&, int)");
+		fit_data(X, Y, n_jobs);
 	}
 
-	void NaiveBayes::fit(const MatrixXf& X, const VectorXi& Y)
+	template<class Derived>
+	void NaiveBayes::fit_data(const EigenBase<Derived>& X, const VectorXi& Y, int n_jobs)
 	{
+		report.reset();
+		auto start = chrono::steady_clock::now();
 		n_class = *std::max_element(Y.data(), Y.data() + Y.size()) + 1;
-		
-		mu = new RowVectorXf[n_class];
-		sigma = new MatrixXf[n_class];
-		prior.resize(n_class);
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), (int)X.rows()));
 
-		// split data by class
-		vector<MatrixXf> splits = split_by_class(X, Y);
+		// every job accumulates its own rows, the partial statistics are merged in order
+		vector<vector<GaussianStatistics>> partial(n_jobs);
+		{
+			SIMPLEML_TIMER(report, "accumulate");
+			parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int job) {
+				accumulate(partial[job], X.derived(), Y, begin, end);
+			});
+		}
+		SIMPLEML_COUNT(report, "rows", X.rows());
 
-		// calculate prior probability of each class
-		for (int i = 0; i < n_class; i++) {
-			prior[i] = (float)splits[i].rows() / X.rows();
+		{
+			SIMPLEML_TIMER(report, "merge");
+			stats = std::move(partial[0]);
+			for (int job = 1; job < n_jobs; job++) {
+				for (int i = 0; i < n_class; i++)
+					stats[i].merge(partial[job][i]);
+			}
 		}
 
-		// calculate mu & sigma of each class
-		for (int i = 0; i < n_class; i++) {
-			mu[i] = splits[i].colwise().mean();
-			MatrixXf centered = (splits[i].rowwise() - mu[i]);
-			sigma[i] = centered.transpose() * centered / (float)(splits[i].size() - 1);
+		finalize();
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	void NaiveBayes::partial_fit(const MatrixXf& X, const VectorXi& Y)
+	{
+		partial_fit_data(X, Y, "partial_fit(const MatrixXf&, const VectorXi&)");
+	}
+
+	void NaiveBayes::partial_fit(const Dataset& X, const VectorXi& Y)
+	{
+		partial_fit_data(X.view(), Y, "partial_fit(const Dataset&, const VectorXi&)");
+	}
+
+	void NaiveBayes::partial_fit(const SparseRowMatrixT<float>& X, const VectorXi& Y)
+	{
+		check_sparse(X, "partial_fit(const SparseRowMatrixT<float>&, const VectorXi&)");
+		partial_fit_data(X, Y, "partial_fit(const SparseRowMatrixT<float>&, const VectorXi&)");
+	}
+
+	template<class Derived>
+	void NaiveBayes::partial_fit_data(const EigenBase<Derived>& X, const VectorXi& Y, const string& caller)
+	{
+		// every chunk has the width of the stored statistics
+		if (X.rows() != Y.size() || (!stats.empty() && X.cols() != stats[0].mean.size())) {
+			cout << "Error(NaiveBayes::" << caller << "): Invalid matrix size." << endl;
+			exit(1);
+		}
+
+		// labels may appear for the first time in any chunk
+		int max_label = *std::max_element(Y.data(), Y.data() + Y.size());
+		n_class = std::max(n_class, max_label + 1);
+
+		accumulate(stats, X.derived(), Y, 0, (int)X.rows());
+		finalize();
+	}
+
+	void NaiveBayes::merge(const NaiveBayes& other)
+	{
+		if (other.stats.empty())
+			return;
+		if (covariance != other.covariance ||
+			(!stats.empty() && stats[0].mean.size() != other.stats[0].mean.size())) {
+			cout << "Error(NaiveBayes::merge(const NaiveBayes&)): Incompatible models." << endl;
+			exit(1);
+		}
+
+		n_class = std::max(n_class, other.n_class);
+		int d = (int)other.stats[0].mean.size();
+		while ((int)stats.size() < n_class) {
+			stats.emplace_back();
+			stats.back().init(d, covariance == "full");
+		}
+		for (int i = 0; i < other.n_class; i++)
+			stats[i].merge(other.stats[i]);
+
+		finalize();
+	}
+
+	template<class Derived>
+	void NaiveBayes::accumulate(vector<GaussianStatistics>& local, const MatrixBase<Derived>& X, const VectorXi& Y,
+		int begin, int end) const
+	{
+		while ((int)local.size() < n_class) {
+			local.emplace_back();
+			local.back().init((int)X.cols(), covariance == "full");
+		}
+		dispatch_dimension((int)X.cols(), [&](auto dim) {
+			accumulate_rows<decltype(dim)::value>(local, X, Y, begin, end);
+		});
+	}
+
+	template<int D, class Derived>
+	void NaiveBayes::accumulate_rows(vector<GaussianStatistics>& local, const MatrixBase<Derived>& X, const VectorXi& Y,
+		int begin, int end) const
+	{
+		/*
+			Welford: M2 += (x - mean_old) * (x - mean_new)t = delta * deltat * (n - 1) / n,
+			on D-vectors that are fixed size (unrolled, on the stack) for a compiled-in D.
+			The statistics of [begin, end) are merged into local, which may hold earlier rows.
+		*/
+		typedef Matrix<double, D, 1> Vector;
+		typedef Matrix<double, D, D> Scatter;
+		int d = (int)X.cols();
+		bool full = covariance == "full";
+		vector<double> count(n_class, 0);
+		vector<Vector, aligned_allocator<Vector>> mean(n_class, Vector::Zero(d));
+		// only the accumulator of the covariance mode, "diag" never holds a d x d scatter
+		vector<Vector, aligned_allocator<Vector>> squares;
+		vector<Scatter, aligned_allocator<Scatter>> scatter;
+		if (full)
+			scatter.assign(n_class, Scatter::Zero(d, d));
+		else
+			squares.assign(n_class, Vector::Zero(d));
+		Vector delta;
+		for (int i = begin; i < end; i++) {
+			int c = Y[i];
+			count[c]++;
+			delta = X.row(i).transpose().template cast<double>() - mean[c];
+			mean[c] += delta / count[c];
+			double weight = (count[c] - 1) / count[c];
+			if (full)
+				scatter[c].template selfadjointView<Lower>().rankUpdate(delta, weight);
+			else
+				squares[c] += delta.cwiseAbs2() * weight;
+		}
+
+		GaussianStatistics chunk;
+		for (int c = 0; c < n_class; c++) {
+			if (count[c] == 0)
+				continue;
+			chunk.init(d, full);
+			chunk.count = count[c];
+			chunk.mean = mean[c];
+			if (full)
+				chunk.M2 = scatter[c];
+			else
+				chunk.M2.col(0) = squares[c];
+			local[c].merge(chunk);
 		}
 	}
 
-	vector<MatrixXf> NaiveBayes::split_by_class(const MatrixXf& X, const VectorXi& Y)
+	void NaiveBayes::accumulate(vector<GaussianStatistics>& local, const SparseRowMatrixT<float>& X, const VectorXi& Y,
+		int begin, int end) const
 	{
-		vector<vector<int>> indicies(n_class);
-		for (int i = 0; i < Y.size(); i++) {
-			indicies[Y[i]].push_back(i);
+		/*
+			"diag" only. The zeros add nothing to the per-class sums of x and x^2,
+			so only the non-zeros are visited; M2 = sum(x^2) - count * mean^2 in
+			double, then merged like the dense chunks.
+		*/
+		int d = (int)X.cols();
+		while ((int)local.size() < n_class) {
+			local.emplace_back();
+			local.back().init(d, false);
 		}
-		
-		vector<MatrixXf> splits(n_class);
-		for (int i = 0; i < indicies.size(); i++) {
-			MatrixXf split(indicies[i].size(), X.cols());
-			for (int j = 0; j < indicies[i].size(); j++) {
-				split.row(j) = X.row(indicies[i][j]);
+		vector<double> count(n_class, 0);
+		vector<VectorXd> sums(n_class), squares(n_class);
+		for (int i = begin; i < end; i++) {
+			int c = Y[i];
+			if (count[c]++ == 0) {
+				sums[c] = VectorXd::Zero(d);
+				squares[c] = VectorXd::Zero(d);
+			}
+			for (SparseRowMatrixT<float>::InnerIterator it(X, i); it; ++it) {
+				double value = it.value();
+				sums[c][it.col()] += value;
+				squares[c][it.col()] += value * value;
 			}
-			splits[i] = split;
 		}
 
-		return splits;
+		GaussianStatistics chunk;
+		for (int c = 0; c < n_class; c++) {
+			if (count[c] == 0)
+				continue;
+			chunk.init(d, false);
+			chunk.count = count[c];
+			chunk.mean = sums[c] / count[c];
+			chunk.M2.col(0) = (squares[c] - sums[c].cwiseProduct(chunk.mean)).cwiseMax(0.);
+			local[c].merge(chunk);
+		}
+	}
+
+	void NaiveBayes::check_sparse(const SparseRowMatrixT<float>& X, const string& caller) const
+	{
+		// a d x d covariance per class is exactly what sparse, high-dimensional data cannot afford
+		if (covariance != "diag") {
+			cout << "Error(NaiveBayes::" << caller << "): Sparse input needs covariance \"diag\"." << endl;
+			exit(1);
+		}
+		if (!stats.empty() && X.cols() != stats[0].mean.size()) {
+			cout << "Error(NaiveBayes::" << caller << "): Invalid matrix size." << endl;
+			exit(1);
+		}
 	}
 
-	VectorXi NaiveBayes::predict(const MatrixXf& X)
+	void NaiveBayes::finalize()
 	{
-		VectorXi predicted(X.rows());
-		for (int i = 0; i < X.rows(); i++) {
-			vector<float> prob(n_class);
+		SIMPLEML_TIMER(report, "finalize");
+		int d = (int)stats[0].mean.size();
+		double total = 0;
+		for (const GaussianStatistics& s : stats)
+			total += s.count;
+
+		means.resize(n_class, d);
+		prior.resize(n_class);
+		if (covariance == "full")
+			sigma.resize(n_class);
+		else
+			variances.resize(n_class, d);
+
+		// calculate prior, mu & sigma of each class
+		for (int i = 0; i < n_class; i++) {
+			const GaussianStatistics& s = stats[i];
+			prior[i] = (float)(s.count / total);
+			if (s.count == 0) {
+				// unseen label; its log prior is -inf, so it is never predicted
+				means.row(i).setZero();
+				if (covariance == "full")
+					sigma[i] = MatrixXf::Identity(d, d);
+				else
+					variances.row(i).setOnes();
+				continue;
+			}
+			double dof = std::max(s.count - 1, 1.);
+			means.row(i) = s.mean.transpose().cast<float>();
+			if (covariance == "full") {
+				MatrixXd cov = s.M2.selfadjointView<Lower>();
+				sigma[i] = (cov / dof).cast<float>();
+			}
+			else {
+				variances.row(i) = (s.M2.col(0).transpose() / dof).cast<float>();
+			}
+		}
+
+		precompute_factors();
+	}
+
+	void NaiveBayes::precompute_factors()
+	{
+		/*
+			log N(x | mu, S) = -0.5 * (d * log(2pi) + log|S| + (x - mu) * S^-1 * (x - mu)t)
+			full: S = L * Lt, log|S| = 2 * sum(log(diag(L)))
+			diag: log|S| = sum(log(var))
+		*/
+		log_prior = prior.array().log();
+		log_det.resize(n_class);
+
+		if (covariance == "full") {
+			chol.resize(n_class);
+			for (int i = 0; i < n_class; i++) {
+				// classes with fewer rows than features have a singular covariance;
+				// add a growing ridge until the factorization succeeds
+				LLT<MatrixXf> llt(sigma[i]);
+				float scale = std::max(sigma[i].diagonal().mean(), 1e-6f);
+				for (float jitter = 1e-6f; llt.info() != Eigen::Success; jitter *= 10) {
+					if (jitter > 1.f) {
+						cout << "Error(NaiveBayes::fit(const MatrixXf&, const VectorXi&)): ";
+						cout << "Covariance of class " << i << " is not positive definite." << endl;
+						exit(1);
+					}
+					MatrixXf ridge = MatrixXf::Identity(sigma[i].rows(), sigma[i].cols()) * (jitter * scale);
+					llt.compute(sigma[i] + ridge);
+				}
+				chol[i] = llt.matrixL();
+				log_det[i] = 2.f * chol[i].diagonal().array().log().sum();
+			}
+		}
+		else {
+			// smooth the variances so that constant features do not divide by zero
+			float epsilon = 1e-9f * std::max(variances.maxCoeff(), 1.f);
+			precisions = (variances.array() + epsilon).inverse();
+			log_det = -precisions.array().log().rowwise().sum().transpose();
+		}
+	}
+
+	const FitReport& NaiveBayes::get_fit_report() const { return report; }
+
+	template<class Derived>
+	MatrixXf NaiveBayes::joint_log_likelihood(const EigenBase<Derived>& X, int n_jobs)
+	{
+		// log P(class) + log P(x | class) for every row and class (N x n_class)
+		MatrixXf joint(X.rows(), n_class);
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int /*job*/) {
+			joint_log_likelihood_rows(X.derived(), begin, end, joint);
+		});
+		return joint;
+	}
+
+	template<class Derived>
+	void NaiveBayes::joint_log_likelihood_rows(const MatrixBase<Derived>& X, int begin, int end, MatrixXf& joint)
+	{
+		const float log_2pi = 1.8378770664093453f;
+		int N = end - begin;
+		auto rows = X.middleRows(begin, N);
+		MatrixXf quad(N, n_class);
+
+		if (covariance == "full") {
+			// (x - mu) * S^-1 * (x - mu)t = |L^-1 * (x - mu)t|^2
+			for (int j = 0; j < n_class; j++) {
+				MatrixXf centered = (rows.rowwise() - means.row(j)).transpose();
+				chol[j].triangularView<Lower>().solveInPlace(centered);
+				quad.col(j) = centered.colwise().squaredNorm().transpose();
+			}
+		}
+		else {
+			// sum_k p_jk * (x_k - m_jk)^2 from the centered rows, one class at a time; the
+			// expansion x^2 * Pt - 2 * x * (M o P)t + sum_k p_jk * m_jk^2 cancels in float
 			for (int j = 0; j < n_class; j++) {
-				prob[j] = multivariate_normal(X.row(i), mu[j], sigma[j]);
-				prob[j] *= prior[j];
+				quad.col(j) = ((rows.rowwise() - means.row(j)).array().square().rowwise() *
+					precisions.row(j).array()).rowwise().sum().matrix();
+			}
+		}
+
+		RowVectorXf constant = log_prior - 0.5f * (log_det.array() + X.cols() * log_2pi).matrix();
+		joint.middleRows(begin, N) = (-0.5f * quad).rowwise() + constant;
+	}
+
+	void NaiveBayes::joint_log_likelihood_rows(const SparseRowMatrixT<float>& X, int begin, int end, MatrixXf& joint)
+	{
+		/*
+			"diag" only. The zeros of a row contribute sum_k p_jk * m_jk^2, and every
+			non-zero x_k swaps its p_jk * m_jk^2 for p_jk * (x_k - m_jk)^2. The terms
+			partly cancel, so they are summed in double.
+		*/
+		const float log_2pi = 1.8378770664093453f;
+		int N = end - begin;
+		ArrayXXd P = precisions.cast<double>().array();
+		ArrayXXd M = means.cast<double>().array();
+		VectorXd offset = (P * M.square()).rowwise().sum().matrix();
+		MatrixXf quad(N, n_class);
+		for (int i = 0; i < N; i++) {
+			VectorXd q = offset;
+			for (SparseRowMatrixT<float>::InnerIterator it(X, begin + i); it; ++it) {
+				int k = (int)it.index();
+				double x = it.value();
+				q.array() += P.col(k) * ((x - M.col(k)).square() - M.col(k).square());
 			}
-			predicted[i] = (int)std::distance(prob.begin(), std::max_element(prob.begin(), prob.end()));
+			quad.row(i) = q.cast<float>().transpose();
+		}
+
+		RowVectorXf constant = log_prior - 0.5f * (log_det.array() + X.cols() * log_2pi).matrix();
+		joint.middleRows(begin, N) = (-0.5f * quad).rowwise() + constant;
+	}
+
+	MatrixXf NaiveBayes::normalize_log(const MatrixXf& joint) const
+	{
+		// normalize with log-sum-exp so that no density is exponentiated on its own
+		VectorXf max = joint.rowwise().maxCoeff();
+		VectorXf log_evidence = max.array() + (joint.colwise() - max).array().exp().rowwise().sum().log();
+		return joint.colwise() - log_evidence;
+	}
+
+	VectorXi NaiveBayes::most_likely(const MatrixXf& joint) const
+	{
+		VectorXi predicted(joint.rows());
+		for (int i = 0; i < joint.rows(); i++) {
+			Index max;
+			joint.row(i).maxCoeff(&max);
+			predicted[i] = (int)max;
 		}
 		return predicted;
 	}
-}
\ No newline at end of file
+
+	MatrixXf NaiveBayes::predict_log_proba(const MatrixXf& X, int n_jobs)
+	{
+		return normalize_log(joint_log_likelihood(X, n_jobs));
+	}
+
+	MatrixXf NaiveBayes::predict_log_proba(const Dataset& X, int n_jobs)
+	{
+		return normalize_log(joint_log_likelihood(X.view(), n_jobs));
+	}
+
+	MatrixXf NaiveBayes::predict_log_proba(const SparseRowMatrixT<float>& X, int n_jobs)
+	{
+		check_sparse(X, "predict_log_proba(const SparseRowMatrixT<float>&, int)");
+		return normalize_log(joint_log_likelihood(X, n_jobs));
+	}
+
+	VectorXi NaiveBayes::predict(const MatrixXf& X, int n_jobs) { return most_likely(joint_log_likelihood(X, n_jobs)); }
+
+	VectorXi NaiveBayes::predict(const Dataset& X, int n_jobs) { return most_likely(joint_log_likelihood(X.view(), n_jobs)); }
+
+	VectorXi NaiveBayes::predict(const SparseRowMatrixT<float>& X, int n_jobs)
+	{
+		check_sparse(X, "predict(const SparseRowMatrixT<float>&, int)");
+		return most_likely(joint_log_likelihood(X, n_jobs));
+	}
+
+	void NaiveBayes::save(const string& path) const
+	{
+		/*
+			the sufficient statistics are saved (the rest is derived from them in
+			finalize), so a loaded model still accepts partial_fit and merge.
+			"full" stacks the n_class d x d M2 matrices, "diag" has one row per class.
+		*/
+		if (stats.empty()) {
+			cout << "Error(NaiveBayes::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		int d = (int)stats[0].mean.size();
+		bool full = covariance == "full";
+		VectorXd counts(n_class);
+		MatrixXd class_means(n_class, d);
+		MatrixXd M2(full ? n_class * d : n_class, d);
+		for (int i = 0; i < n_class; i++) {
+			counts[i] = stats[i].count;
+			class_means.row(i) = stats[i].mean.transpose();
+			if (full)
+				M2.middleRows(i * d, d) = stats[i].M2;
+			else
+				M2.row(i) = stats[i].M2.col(0).transpose();
+		}
+
+		ModelWriter writer(path, "NaiveBayes", 1);
+		writer.write_string(covariance);
+		writer.write_int(n_class);
+		writer.write_array(counts);
+		writer.write_array(class_means);
+		writer.write_array(M2);
+		writer.close();
+	}
+
+	void NaiveBayes::load(const string& path)
+	{
+		ModelReader reader(path, "NaiveBayes", 1);
+		covariance = reader.read_string();
+		n_class = (int)reader.read_int();
+		VectorXd counts;
+		MatrixXd class_means, M2;
+		reader.read_matrix(counts);
+		reader.read_matrix(class_means);
+		reader.read_matrix(M2);
+		int d = (int)class_means.cols();
+		bool full = covariance == "full";
+		if ((!full && covariance != "diag") || n_class < 1 || counts.size() != n_class ||
+			class_means.rows() != n_class || M2.rows() != (full ? n_class * d : n_class) || M2.cols() != d) {
+			cout << "Error(NaiveBayes::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
+
+		stats.assign(n_class, GaussianStatistics());
+		for (int i = 0; i < n_class; i++) {
+			stats[i].init(d, full);
+			stats[i].count = counts[i];
+			stats[i].mean = class_means.row(i).transpose();
+			if (full)
+				stats[i].M2 = M2.middleRows(i * d, d);
+			else
+				stats[i].M2.col(0) = M2.row(i).transpose();
+		}
+		finalize();
+	}
+}
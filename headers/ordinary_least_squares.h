@@ -1,24 +1,110 @@
 #pragma once
 #include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <limits>
+#include <algorithm>
 #include <Eigen/Dense>
+#include "common.h"
+#include "parallel.h"
+#include "instrumentation.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
 namespace SimpleML
 {
-	class OLS
+	/*
+		Scalar is the type of A, B and the coefficients. The normal equations
+		(cholesky, ldlt) are formed and factorized in Accumulator, so float data
+		can be solved with a double At * A; QR and SVD work on A itself in Scalar.
+		Sparse A is solved by LSQR (max_iter, tol), which only needs A * v and
+		At * u, so it costs O(nnz) per iteration and never forms At * A.
+	*/
+	template<class Scalar, class Accumulator = Scalar>
+	class BasicOLS
 	{
 	private:
+		string solver;
+		string fitted_solver;
+		int max_iter;
+		Scalar tol;
+		MatrixT<Scalar> coeffs;				// p x n_target
+		// factorization of A cached by factorize(); fit() keeps none of it
+		bool is_factorized;
+		Index n_design_rows;
+		MatrixT<Scalar> design;				// A itself, the normal equations need At * B for every solve
+		LLT<MatrixT<Accumulator>> llt;
+		LDLT<MatrixT<Accumulator>> ldlt;
+		ColPivHouseholderQR<MatrixT<Scalar>> qr;
+		BDCSVD<MatrixT<Scalar>> bdcsvd;
+		JacobiSVD<MatrixT<Scalar>> jacobi;
+		FitReport report;
+	public:
+		BasicOLS(string solver = "auto", int max_iter = 1000, Scalar tol = (Scalar)1e-6);
+		void fit(const MatrixT<Scalar>& A, const MatrixT<Scalar>& B);
+		void fit(const SparseRowMatrixT<Scalar>& A, const MatrixT<Scalar>& B);
+		void factorize(const MatrixT<Scalar>& A);
+		MatrixT<Scalar> solve(const MatrixT<Scalar>& B);
+		MatrixT<Scalar> predict(const MatrixT<Scalar>& A);
+		MatrixT<Scalar> predict(const SparseRowMatrixT<Scalar>& A);
+		MatrixT<Scalar> get_coeffs() const;
+		string get_fitted_solver() const;
+		const FitReport& get_fit_report() const;
+		void save(const string& path) const;
+		void load(const string& path);
+	private:
+		void factorize_matrix(const MatrixT<Scalar>& A);
+		MatrixT<Scalar> back_substitute(const MatrixT<Scalar>& A, const MatrixT<Scalar>& B);
+		void release();
+		bool factorize_normal_equations(const MatrixT<Scalar>& A, bool pivoting, Accumulator max_condition);
+		bool factorize_qr(const MatrixT<Scalar>& A, bool check_rank);
+		MatrixT<Accumulator> transpose_product(const MatrixT<Scalar>& A, const MatrixT<Scalar>& B);
+		VectorT<Scalar> lsqr(const SparseRowMatrixT<Scalar>& A, const VectorT<Scalar>& b);
+	};
+
+	typedef BasicOLS<float> OLS;
+	typedef BasicOLS<double> OLSd;
+
+	class IncrementalOLS
+	{
+	private:
+		bool fit_intercept;
+		long long n_samples;
+		MatrixXd gram;		// At * A (lower triangle), with the implicit constant column first
+		VectorXd moment;	// At * b
 		VectorXf coeffs;
 	public:
-		OLS();
-		void fit(const MatrixXf& A, const VectorXf& b);
+		IncrementalOLS(bool fit_intercept = false);
+		void fit(const MatrixXf& A, const VectorXf& b, int n_jobs = 1);
+		void partial_fit(const MatrixXf& A, const VectorXf& b);
+		void merge(const IncrementalOLS& other);
+		void finalize();
 		VectorXf predict(const MatrixXf& A);
+		VectorXf get_coeffs() const;
+		void save(const string& path) const;
+		void load(const string& path);
+	private:
+		void reset(int n_col);
+		void accumulate(const MatrixXf& A, const VectorXf& b, int begin, int end);
 	};
 
-	OLS::OLS() {};
+	/*---------------------------------------------------------------------------------------*/
 
-	void OLS::fit(const MatrixXf& A, const VectorXf& b)
+	template<class Scalar, class Accumulator>
+	BasicOLS<Scalar, Accumulator>::BasicOLS(string solver, int max_iter, Scalar tol) :
+		solver(solver), max_iter(max_iter), tol(tol), is_factorized(false), n_design_rows(0)
+	{
+		if (solver != "auto" && solver != "cholesky" && solver != "ldlt" &&
+			solver != "qr" && solver != "bdcsvd" && solver != "jacobi") {
+			cout << "Error(BasicOLS(string, int, Scalar)): Invalid solver option." << endl;
+			exit(1);
+		}
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::fit(const MatrixT<Scalar>& A, const MatrixT<Scalar>& B)
 	{
 		/*
 			---------- OLS ----------
@@ -31,21 +117,486 @@ namespace SimpleML
 			x = A+ * b
 			---------- Note ---------
 			(At * A)^-1 * At = V * (St * S)^-1 * St * Vt
+			Every column of B is a separate target solved against the same
+			factorization of A, so coeffs is p x B.cols(). Neither A nor its
+			factorization is kept afterwards; use factorize() and solve() to
+			solve further targets against the same A.
+		*/
+		if (A.rows() != B.rows()) {
+			cout << "Error(BasicOLS::fit(const MatrixT<Scalar>&, const MatrixT<Scalar>&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		report.reset();
+		auto start = chrono::steady_clock::now();
+		{
+			SIMPLEML_TIMER(report, "factorize");
+			release();
+			factorize_matrix(A);
+		}
+		{
+			SIMPLEML_TIMER(report, "solve");
+			back_substitute(A, B);
+		}
+		release();
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::fit(const SparseRowMatrixT<Scalar>& A, const MatrixT<Scalar>& B)
+	{
+		/*
+			every target is solved by LSQR on A itself, whatever the solver option
+			(the dense factorizations do not apply). Nothing is cached, so solve()
+			needs factorize() on a dense A. n_iter is summed over the targets.
 		*/
+		if (A.rows() != B.rows()) {
+			cout << "Error(BasicOLS::fit(const SparseRowMatrixT<Scalar>&, const MatrixT<Scalar>&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		report.reset();
+		auto start = chrono::steady_clock::now();
+		report.converged = true;
+		fitted_solver = "lsqr";
+		release();
+		coeffs.resize(A.cols(), B.cols());
+		{
+			SIMPLEML_TIMER(report, "lsqr");
+			for (int j = 0; j < B.cols(); j++)
+				coeffs.col(j) = lsqr(A, B.col(j));
+		}
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	template<class Scalar, class Accumulator>
+	VectorT<Scalar> BasicOLS<Scalar, Accumulator>::lsqr(const SparseRowMatrixT<Scalar>& A, const VectorT<Scalar>& b)
+	{
+		/*
+			Paige & Saunders: Golub-Kahan bidiagonalization of A started from b,
+			with the small least squares problem updated by Givens rotations.
+			Stops when |r| <= tol * |b| (consistent system) or
+			|At * r| <= tol * |A| * |r| (least squares), both estimated from the
+			recurrences. The estimate of |At * r| / |r| goes to the history.
+		*/
+		VectorT<Scalar> x = VectorT<Scalar>::Zero(A.cols());
+		VectorT<Scalar> u = b;
+		Scalar beta = u.norm();
+		if (beta == 0)
+			return x;
+		u /= beta;
+		VectorT<Scalar> v = A.transpose() * u;
+		Scalar alpha = v.norm();
+		if (alpha == 0)
+			return x;
+		v /= alpha;
+
+		VectorT<Scalar> w = v;
+		Scalar phibar = beta, rhobar = alpha;
+		Scalar b_norm = beta, a_norm = 0;
+		bool converged = false;
+		for (int iter = 0; iter < max_iter; iter++) {
+			u = A * v - alpha * u;
+			beta = u.norm();
+			if (beta > 0)
+				u /= beta;
+			a_norm = std::sqrt(a_norm * a_norm + alpha * alpha + beta * beta);
+			v = A.transpose() * u - beta * v;
+			alpha = v.norm();
+			if (alpha > 0)
+				v /= alpha;
+
+			Scalar rho = std::sqrt(rhobar * rhobar + beta * beta);
+			Scalar c = rhobar / rho, s = beta / rho;
+			Scalar theta = s * alpha;
+			rhobar = -c * alpha;
+			Scalar phi = c * phibar;
+			phibar = s * phibar;
+			x += (phi / rho) * w;
+			w = v - (theta / rho) * w;
+
+			Scalar r_norm = phibar, ar_norm = phibar * alpha * std::abs(c);
+			report.n_iter++;
+			report.history.push_back(r_norm > 0 ? ar_norm / r_norm : 0);
+			if (r_norm <= tol * b_norm || ar_norm <= tol * a_norm * r_norm) {
+				converged = true;
+				break;
+			}
+		}
+		report.converged = report.converged && converged;
+		return x;
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::factorize(const MatrixT<Scalar>& A)
+	{
+		// the normal equations also keep A, every solve() needs At * B
+		release();
+		factorize_matrix(A);
+		if (fitted_solver == "cholesky" || fitted_solver == "ldlt")
+			design = A;
+		n_design_rows = A.rows();
+		is_factorized = true;
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::release()
+	{
+		// drops everything of size O(n * p); coeffs stay
+		is_factorized = false;
+		n_design_rows = 0;
+		design.resize(0, 0);
+		qr = ColPivHouseholderQR<MatrixT<Scalar>>();
+		bdcsvd = BDCSVD<MatrixT<Scalar>>();
+		jacobi = JacobiSVD<MatrixT<Scalar>>();
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::factorize_matrix(const MatrixT<Scalar>& A)
+	{
+		/*
+			-------- Solvers --------
+			cholesky, ldlt: normal equations, O(n * p^2) + a p x p factorization
+			qr: column-pivoting Householder QR of A, O(n * p^2) with a larger constant
+			bdcsvd, jacobi: SVD of A, minimum-norm solution even if A is rank deficient
+			auto: normal equations on tall, well-conditioned A, then QR, then BDCSVD
+		*/
+		fitted_solver = solver;
+		if (solver == "cholesky") {
+			if (!factorize_normal_equations(A, false, 0)) {
+				cout << "Error(BasicOLS::factorize(const MatrixT<Scalar>&)): At * A is not positive definite." << endl;
+				exit(1);
+			}
+		}
+		else if (solver == "ldlt") {
+			factorize_normal_equations(A, true, 0);
+		}
+		else if (solver == "qr") {
+			factorize_qr(A, false);
+		}
+		else if (solver == "bdcsvd") {
+			bdcsvd.compute(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+		}
+		else if (solver == "jacobi") {
+			jacobi.compute(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+		}
+		else {
+			/*
+				the normal equations lose about cond(At * A) * epsilon(Accumulator);
+				they are trusted while that stays within 1e4 * epsilon(Scalar), i.e.
+				cond(At * A) <= 1e4 with a single type and far more with a double
+				Accumulator for float data
+			*/
+			Accumulator max_condition = (Accumulator)1e4 *
+				((Accumulator)std::numeric_limits<Scalar>::epsilon() / std::numeric_limits<Accumulator>::epsilon());
+			if (A.rows() >= A.cols() && factorize_normal_equations(A, true, max_condition)) {
+				fitted_solver = "ldlt";
+			}
+			else if (A.rows() >= A.cols() && factorize_qr(A, true)) {
+				fitted_solver = "qr";
+			}
+			else {
+				bdcsvd.compute(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+				fitted_solver = "bdcsvd";
+			}
+		}
+	}
+
+	template<class Scalar, class Accumulator>
+	MatrixT<Scalar> BasicOLS<Scalar, Accumulator>::solve(const MatrixT<Scalar>& B)
+	{
+		// only a back-substitution (plus At * B for the normal equations) per call
+		if (!is_factorized) {
+			cout << "Error(BasicOLS::solve(const MatrixT<Scalar>&)): The model must be factorized first." << endl;
+			exit(1);
+		}
+		if (B.rows() != n_design_rows) {
+			cout << "Error(BasicOLS::solve(const MatrixT<Scalar>&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		return back_substitute(design, B);
+	}
+
+	template<class Scalar, class Accumulator>
+	MatrixT<Scalar> BasicOLS<Scalar, Accumulator>::back_substitute(const MatrixT<Scalar>& A, const MatrixT<Scalar>& B)
+	{
+		// A is read by the normal equations only
+		if (fitted_solver == "cholesky" || fitted_solver == "ldlt") {
+			MatrixT<Accumulator> rhs = transpose_product(A, B);
+			if (fitted_solver == "cholesky")
+				coeffs = llt.solve(rhs).template cast<Scalar>();
+			else
+				coeffs = ldlt.solve(rhs).template cast<Scalar>();
+		}
+		else if (fitted_solver == "qr") {
+			coeffs = qr.solve(B);
+		}
+		else if (fitted_solver == "bdcsvd") {
+			coeffs = bdcsvd.solve(B);
+		}
+		else {
+			coeffs = jacobi.solve(B);
+		}
+		return coeffs;
+	}
+
+	template<class Scalar, class Accumulator>
+	bool BasicOLS<Scalar, Accumulator>::factorize_normal_equations(const MatrixT<Scalar>& A, bool pivoting, Accumulator max_condition)
+	{
+		// returns false if the factorization fails or cond(At * A) exceeds max_condition (0: unchecked)
+		// widen a block of rows at a time instead of all of A
+		const int block_size = 4096;
+		MatrixT<Accumulator> gram = MatrixT<Accumulator>::Zero(A.cols(), A.cols());
+		for (int first = 0; first < A.rows(); first += block_size) {
+			int rows = std::min(block_size, (int)A.rows() - first);
+			MatrixT<Accumulator> block = A.middleRows(first, rows).template cast<Accumulator>();
+			gram.template selfadjointView<Lower>().rankUpdate(block.transpose());
+		}
+
+		if (!pivoting) {
+			llt.compute(gram);
+			return llt.info() == Eigen::Success;
+		}
+
+		ldlt.compute(gram);
+		if (ldlt.info() != Eigen::Success)
+			return false;
+		if (max_condition > 0) {
+			// rcond() estimates 1 / cond(At * A) in the 1-norm; the ratio of the pivots
+			// of D is only a lower bound on cond and misses e.g. nearly collinear columns
+			Accumulator rcond = ldlt.rcond();
+			if (!(rcond > 0) || rcond < 1 / max_condition)
+				return false;
+		}
+		return true;
+	}
+
+	template<class Scalar, class Accumulator>
+	MatrixT<Accumulator> BasicOLS<Scalar, Accumulator>::transpose_product(const MatrixT<Scalar>& A, const MatrixT<Scalar>& B)
+	{
+		// At * B in Accumulator, one block of rows at a time
+		const int block_size = 4096;
+		MatrixT<Accumulator> product = MatrixT<Accumulator>::Zero(A.cols(), B.cols());
+		for (int first = 0; first < A.rows(); first += block_size) {
+			int rows = std::min(block_size, (int)A.rows() - first);
+			MatrixT<Accumulator> block = A.middleRows(first, rows).template cast<Accumulator>();
+			product.noalias() += block.transpose() * B.middleRows(first, rows).template cast<Accumulator>();
+		}
+		return product;
+	}
 
-		JacobiSVD<MatrixXf> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
-		coeffs = svd.solve(b);
+	template<class Scalar, class Accumulator>
+	bool BasicOLS<Scalar, Accumulator>::factorize_qr(const MatrixT<Scalar>& A, bool check_rank)
+	{
+		// returns false if check_rank is set and A is rank deficient
+		qr.compute(A);
+		return !check_rank || qr.rank() == A.cols();
+	}
 
-		cout << "OLS coefficients: ";
-		cout << coeffs.transpose() << endl;
+	template<class Scalar, class Accumulator>
+	MatrixT<Scalar> BasicOLS<Scalar, Accumulator>::predict(const MatrixT<Scalar>& A)
+	{
+		if (A.cols() != coeffs.rows()) {
+			cout << "Error(BasicOLS::predict(const MatrixT<Scalar>&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		return A * coeffs;
 	}
 
-	VectorXf OLS::predict(const MatrixXf& A)
+	template<class Scalar, class Accumulator>
+	MatrixT<Scalar> BasicOLS<Scalar, Accumulator>::predict(const SparseRowMatrixT<Scalar>& A)
 	{
-		if (A.cols() != coeffs.size()) {
-			cout << "LinearRegression::predict(const MatrixXf&): Invalid matrix size." << endl;
+		if (A.cols() != coeffs.rows()) {
+			cout << "Error(BasicOLS::predict(const SparseRowMatrixT<Scalar>&)): Invalid matrix size." << endl;
 			exit(1);
 		}
 		return A * coeffs;
 	}
+
+	template<class Scalar, class Accumulator>
+	MatrixT<Scalar> BasicOLS<Scalar, Accumulator>::get_coeffs() const { return coeffs; }
+
+	template<class Scalar, class Accumulator>
+	string BasicOLS<Scalar, Accumulator>::get_fitted_solver() const { return fitted_solver; }
+
+	template<class Scalar, class Accumulator>
+	const FitReport& BasicOLS<Scalar, Accumulator>::get_fit_report() const { return report; }
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::save(const string& path) const
+	{
+		// the coefficients only; solve() on a loaded model needs factorize() again
+		if (coeffs.size() == 0) {
+			cout << "Error(BasicOLS::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		ModelWriter writer(path, "OLS", 1);
+		writer.write_string(solver);
+		writer.write_string(fitted_solver);
+		writer.write_array(coeffs);
+		writer.close();
+	}
+
+	template<class Scalar, class Accumulator>
+	void BasicOLS<Scalar, Accumulator>::load(const string& path)
+	{
+		ModelReader reader(path, "OLS", 1);
+		solver = reader.read_string();
+		fitted_solver = reader.read_string();
+		reader.read_matrix(coeffs);
+		release();
+	}
+
+	IncrementalOLS::IncrementalOLS(bool fit_intercept) : fit_intercept(fit_intercept), n_samples(0) {}
+
+	void IncrementalOLS::reset(int n_col)
+	{
+		int p = n_col + (fit_intercept ? 1 : 0);
+		n_samples = 0;
+		gram = MatrixXd::Zero(p, p);
+		moment = VectorXd::Zero(p);
+	}
+
+	void IncrementalOLS::fit(const MatrixXf& A, const VectorXf& b, int n_jobs)
+	{
+		if (A.rows() != b.size()) {
+			cout << "Error(IncrementalOLS::fit(const MatrixXf&, const VectorXf&, int)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), (int)A.rows()));
+
+		// every job accumulates its own rows, the partial sums are merged in order
+		vector<IncrementalOLS> partial(n_jobs, IncrementalOLS(fit_intercept));
+		parallel_for(0, (int)A.rows(), n_jobs, [&](int begin, int end, int job) {
+			partial[job].reset((int)A.cols());
+			partial[job].accumulate(A, b, begin, end);
+		});
+
+		reset((int)A.cols());
+		for (const IncrementalOLS& other : partial)
+			merge(other);
+		finalize();
+	}
+
+	void IncrementalOLS::partial_fit(const MatrixXf& A, const VectorXf& b)
+	{
+		if (A.rows() != b.size()) {
+			cout << "Error(IncrementalOLS::partial_fit(const MatrixXf&, const VectorXf&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		if (n_samples == 0)
+			reset((int)A.cols());
+		accumulate(A, b, 0, (int)A.rows());
+	}
+
+	void IncrementalOLS::accumulate(const MatrixXf& A, const VectorXf& b, int begin, int end)
+	{
+		int p = (int)gram.rows();
+		if (p != A.cols() + (fit_intercept ? 1 : 0)) {
+			cout << "Error(IncrementalOLS::partial_fit(const MatrixXf&, const VectorXf&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+
+		// widen a block of rows at a time; the constant column is written, never copied from A
+		const int block_size = 4096;
+		int offset = fit_intercept ? 1 : 0;
+		MatrixXd block(std::min(block_size, end - begin), p);
+		for (int first = begin; first < end; first += block_size) {
+			int rows = std::min(block_size, end - first);
+			if (rows != block.rows())
+				block.resize(rows, p);
+			if (fit_intercept)
+				block.col(0).setOnes();
+			block.rightCols(p - offset) = A.middleRows(first, rows).cast<double>();
+
+			gram.selfadjointView<Lower>().rankUpdate(block.transpose());
+			moment.noalias() += block.transpose() * b.segment(first, rows).cast<double>();
+		}
+		n_samples += end - begin;
+	}
+
+	void IncrementalOLS::merge(const IncrementalOLS& other)
+	{
+		// a model that was never reset has no width yet and takes the one of other
+		if (other.n_samples == 0)
+			return;
+		if (fit_intercept != other.fit_intercept || (gram.size() != 0 && gram.rows() != other.gram.rows())) {
+			cout << "Error(IncrementalOLS::merge(const IncrementalOLS&)): Incompatible models." << endl;
+			exit(1);
+		}
+		if (n_samples == 0) {
+			gram = other.gram;
+			moment = other.moment;
+			n_samples = other.n_samples;
+			return;
+		}
+		gram += other.gram;
+		moment += other.moment;
+		n_samples += other.n_samples;
+	}
+
+	void IncrementalOLS::finalize()
+	{
+		/*
+			(At * A)x = At * b on the accumulated p x p system. A singular system
+			(e.g. a duplicated column) falls back to the minimum-norm solution.
+		*/
+		if (n_samples == 0) {
+			cout << "Error(IncrementalOLS::finalize()): No data accumulated." << endl;
+			exit(1);
+		}
+		MatrixXd full = gram.selfadjointView<Lower>();
+		LDLT<MatrixXd> ldlt(full);
+		VectorXd D = ldlt.vectorD().cwiseAbs();
+		if (ldlt.info() == Eigen::Success && D.minCoeff() > 1e-12 * D.maxCoeff()) {
+			coeffs = ldlt.solve(moment).cast<float>();
+		}
+		else {
+			CompleteOrthogonalDecomposition<MatrixXd> cod(full);
+			coeffs = cod.solve(moment).cast<float>();
+		}
+	}
+
+	VectorXf IncrementalOLS::predict(const MatrixXf& A)
+	{
+		int offset = fit_intercept ? 1 : 0;
+		if (A.cols() + offset != coeffs.size()) {
+			cout << "IncrementalOLS::predict(const MatrixXf&): Invalid matrix size." << endl;
+			exit(1);
+		}
+		VectorXf predicted = A * coeffs.tail(A.cols());
+		if (fit_intercept)
+			predicted.array() += coeffs[0];
+		return predicted;
+	}
+
+	VectorXf IncrementalOLS::get_coeffs() const { return coeffs; }
+
+	void IncrementalOLS::save(const string& path) const
+	{
+		// the accumulated system is kept, so a loaded model can take more partial_fit calls
+		if (n_samples == 0) {
+			cout << "Error(IncrementalOLS::save(const string&)): No data accumulated." << endl;
+			exit(1);
+		}
+		ModelWriter writer(path, "IncrementalOLS", 1);
+		writer.write_int(fit_intercept);
+		writer.write_int(n_samples);
+		writer.write_array(gram);
+		writer.write_array(moment);
+		writer.write_array(coeffs);
+		writer.close();
+	}
+
+	void IncrementalOLS::load(const string& path)
+	{
+		ModelReader reader(path, "IncrementalOLS", 1);
+		fit_intercept = reader.read_int() != 0;
+		n_samples = reader.read_int();
+		reader.read_matrix(gram);
+		reader.read_matrix(moment);
+		reader.read_matrix(coeffs);
+		if (gram.rows() != gram.cols() || moment.size() != gram.rows()) {
+			cout << "Error(IncrementalOLS::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
+	}
 }
\ No newline at end of file
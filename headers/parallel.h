@@ -0,0 +1,224 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+using namespace std;
+
+namespace SimpleML
+{
+	class ThreadPool
+	{
+		/*
+			Work-stealing pool: every worker owns a deque. Tasks submitted from a
+			worker (nested parallel calls) go to its own deque and are taken back
+			LIFO, so the freshest, cache-hot work runs first; idle workers steal
+			the oldest tasks of the others. Tasks from other threads go to a
+			shared injection queue. The pool never grows, so nested parallel
+			regions share the same fixed set of threads instead of multiplying them.
+		*/
+	private:
+		struct TaskQueue
+		{
+			mutex lock;
+			deque<function<void()>> tasks;
+		};
+		vector<thread> workers;
+		vector<unique_ptr<TaskQueue>> queues;	// one per worker, the last one is the injection queue
+		mutex sleep_lock;
+		condition_variable cv;
+		atomic<int> pending;
+		bool stop;
+	public:
+		ThreadPool(int n_threads);
+		~ThreadPool();
+		int size() const;
+		void submit(function<void()> task);
+		bool run_pending();
+	private:
+		void worker_loop(int index);
+		bool pop(TaskQueue& queue, bool back, function<void()>& task);
+		int& worker_index();
+	};
+
+	ThreadPool& default_thread_pool();
+
+	int resolve_n_jobs(int n_jobs);
+
+	template<class F>
+	void parallel_for(int begin, int end, int n_jobs, F f);
+
+	template<class T, class F, class C>
+	T parallel_reduce(int begin, int end, int n_jobs, T identity, F f, C combine);
+
+	/*---------------------------------------------------------------------------------------*/
+
+	ThreadPool::ThreadPool(int n_threads) : pending(0), stop(false)
+	{
+		for (int i = 0; i <= n_threads; i++)
+			queues.emplace_back(new TaskQueue);
+		for (int i = 0; i < n_threads; i++)
+			workers.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			unique_lock<mutex> guard(sleep_lock);
+			stop = true;
+		}
+		cv.notify_all();
+		for (thread& worker : workers)
+			worker.join();
+	}
+
+	int ThreadPool::size() const { return (int)workers.size(); }
+
+	int& ThreadPool::worker_index()
+	{
+		// index of the calling thread's deque, -1 outside the pool
+		static thread_local int index = -1;
+		return index;
+	}
+
+	void ThreadPool::submit(function<void()> task)
+	{
+		int index = worker_index();
+		TaskQueue& queue = *queues[index >= 0 ? index : queues.size() - 1];
+		{
+			unique_lock<mutex> guard(queue.lock);
+			queue.tasks.push_back(std::move(task));
+		}
+		{
+			// counted under sleep_lock, so a worker about to sleep cannot miss it
+			unique_lock<mutex> guard(sleep_lock);
+			pending++;
+		}
+		cv.notify_one();
+	}
+
+	bool ThreadPool::pop(TaskQueue& queue, bool back, function<void()>& task)
+	{
+		unique_lock<mutex> guard(queue.lock);
+		if (queue.tasks.empty())
+			return false;
+		if (back) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		return true;
+	}
+
+	bool ThreadPool::run_pending()
+	{
+		// own deque first (newest task), then the injection queue, then steal (oldest task)
+		if (pending == 0)
+			return false;
+		int index = worker_index();
+		int n_queue = (int)queues.size();
+		function<void()> task;
+		bool found = index >= 0 && pop(*queues[index], true, task);
+		for (int k = 0; !found && k < n_queue; k++) {
+			int victim = (n_queue - 1 + k) % n_queue;
+			if (victim != index)
+				found = pop(*queues[victim], false, task);
+		}
+		if (!found)
+			return false;
+		pending--;
+		task();
+		return true;
+	}
+
+	void ThreadPool::worker_loop(int index)
+	{
+		worker_index() = index;
+		while (true) {
+			if (run_pending())
+				continue;
+			unique_lock<mutex> guard(sleep_lock);
+			cv.wait(guard, [&]() { return stop || pending > 0; });
+			if (stop && pending == 0)
+				return;
+		}
+	}
+
+	ThreadPool& default_thread_pool()
+	{
+		// the calling thread always takes part, so one worker fewer than there are cores
+		static ThreadPool pool(std::max(1, (int)std::thread::hardware_concurrency() - 1));
+		return pool;
+	}
+
+	int resolve_n_jobs(int n_jobs)
+	{
+		// n_jobs <= 0 means "use every core"
+		if (n_jobs > 0)
+			return n_jobs;
+		return std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	template<class F>
+	void parallel_for(int begin, int end, int n_jobs, F f)
+	{
+		/*
+			splits [begin, end) into n_jobs contiguous chunks and calls
+			f(chunk_begin, chunk_end, job) once per chunk. The first chunk runs on
+			the calling thread, the others on the default thread pool; with
+			n_jobs == 1 nothing is queued at all. While waiting, the caller runs
+			queued tasks itself, so nested parallel_for calls cannot deadlock.
+		*/
+		int size = end - begin;
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), size));
+		if (n_jobs == 1) {
+			f(begin, end, 0);
+			return;
+		}
+
+		ThreadPool& pool = default_thread_pool();
+		atomic<int> remaining(n_jobs - 1);
+		for (int job = 1; job < n_jobs; job++) {
+			int first = begin + (int)((long long)size * job / n_jobs);
+			int last = begin + (int)((long long)size * (job + 1) / n_jobs);
+			pool.submit([&f, &remaining, first, last, job]() {
+				f(first, last, job);
+				remaining--;
+			});
+		}
+		f(begin, begin + (int)((long long)size / n_jobs), 0);
+
+		while (remaining > 0) {
+			if (!pool.run_pending())
+				std::this_thread::yield();
+		}
+	}
+
+	template<class T, class F, class C>
+	T parallel_reduce(int begin, int end, int n_jobs, T identity, F f, C combine)
+	{
+		/*
+			f(chunk_begin, chunk_end) -> T on every chunk of parallel_for, then the
+			partial results are combined in chunk order. The chunks depend only on
+			n_jobs, so a given n_jobs always sums in the same order, and n_jobs == 1
+			is exactly the sequential loop.
+		*/
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), end - begin));
+		vector<T> partial(n_jobs, identity);
+		parallel_for(begin, end, n_jobs, [&](int first, int last, int job) {
+			partial[job] = f(first, last);
+		});
+		T result = identity;
+		for (const T& value : partial)
+			result = combine(result, value);
+		return result;
+	}
+}
@@ -3,8 +3,14 @@
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <string>
+#include <random>
+#include <chrono>
 #include <Eigen/Dense>
 #include <Eigen/LU>
+#include "common.h"
+#include "instrumentation.h"
+#include "serialization.h"
 using namespace std;
 using namespace Eigen;
 
@@ -14,22 +20,76 @@ namespace SimpleML
 	{
 	private:
 		int n_component;
+		string solver;
+		int n_oversamples;
+		int n_power_iter;
+		bool whiten;
+		int random_state;
 		bool is_fitted;
+		FitReport report;
 	public:
 		MatrixXf U;
 		VectorXf S;
+		MatrixXf V;
+		RowVectorXf mean;
+		MatrixXf components;				// d x n_component, the leading columns of V
+		VectorXf explained_variance;
+		VectorXf explained_variance_ratio;
 	public:
-		PCA(int n_component);
-		void fit(const MatrixXf& X);
+		PCA(int n_component, string solver = "auto", int n_oversamples = 10, int n_power_iter = 4,
+			bool whiten = false, int random_state = -1);
+		void fit(const MatrixXf& X, int n_jobs = 1);
+		void fit(const SparseRowMatrixT<float>& X, int n_jobs = 1);
 		MatrixXf transform(const MatrixXf& X);
-		MatrixXf fit_transform(const MatrixXf& X);
+		MatrixXf transform(const SparseRowMatrixT<float>& X);
+		MatrixXf fit_transform(const MatrixXf& X, int n_jobs = 1);
+		MatrixXf fit_transform(const SparseRowMatrixT<float>& X, int n_jobs = 1);
+		MatrixXf inverse_transform(const MatrixXf& Z);
+		const FitReport& get_fit_report() const;
+		void save(const string& path) const;
+		void load(const string& path);
 	private:
-		void fit_implementation(const MatrixXf& X);
+		void fit_implementation(const MatrixXf& X, int n_jobs);
+		template<class Derived>
+		void randomized_svd(const EigenBase<Derived>& data);
+		void covariance_eigen(const MatrixXf& X, int n_jobs);
+	};
+
+	class IncrementalPCA
+	{
+	private:
+		int n_component;
+		int batch_size;
+		long long n_samples_seen;
+		VectorXd running_mean;		// double, so that many small batches do not drift
+		VectorXd running_M2;		// per-feature sum of squared deviations
+	public:
+		VectorXf S;
+		RowVectorXf mean;
+		MatrixXf components;				// d x n_component
+		VectorXf explained_variance;
+		VectorXf explained_variance_ratio;
+	public:
+		IncrementalPCA(int n_component, int batch_size = 0);
+		void fit(const MatrixXf& X);
+		void partial_fit(const MatrixXf& X);
+		MatrixXf transform(const MatrixXf& X);
+		MatrixXf inverse_transform(const MatrixXf& Z);
+		void save(const string& path) const;
+		void load(const string& path);
 	};
 	
-	PCA::PCA(int n_component) : n_component(n_component), is_fitted(false) {}
+	PCA::PCA(int n_component, string solver, int n_oversamples, int n_power_iter, bool whiten, int random_state) :
+		n_component(n_component), solver(solver), n_oversamples(n_oversamples),
+		n_power_iter(n_power_iter), whiten(whiten), random_state(random_state), is_fitted(false)
+	{
+		if (solver != "auto" && solver != "full" && solver != "randomized" && solver != "covariance") {
+			cout << "Error(PCA(int, string, int, int, bool, int)): Invalid solver option." << endl;
+			exit(1);
+		}
+	}
 
-	void PCA::fit(const MatrixXf& X)
+	void PCA::fit(const MatrixXf& X, int n_jobs)
 	{
 		if (X.cols() < n_component) {
 			cout << "Error(PCA::fit(const MatrixXf&): The number of features ";
@@ -37,20 +97,190 @@ namespace SimpleML
 			exit(1);
 		}
 
-		fit_implementation(X);
+		report.reset();
+		auto start = chrono::steady_clock::now();
+		fit_implementation(X, n_jobs);
+		is_fitted = true;
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	void PCA::fit(const SparseRowMatrixT<float>& X, int n_jobs)
+	{
+		/*
+			truncated SVD: centering would densify X, so the mean is taken as zero
+			and the components are the top right singular vectors of X itself
+			(equal to PCA only for data that is already centered). The randomized
+			solver touches X through X * M and Xt * M only, O(nnz * l) per pass.
+		*/
+		if (X.cols() < n_component) {
+			cout << "Error(PCA::fit(const SparseRowMatrixT<float>&): The number of features ";
+			cout << "must be greater than or equal to the number of components." << endl;
+			exit(1);
+		}
+		if (solver != "auto" && solver != "randomized") {
+			cout << "Error(PCA::fit(const SparseRowMatrixT<float>&): Sparse input needs the randomized solver." << endl;
+			exit(1);
+		}
+
+		report.reset();
+		auto start = chrono::steady_clock::now();
+		mean = RowVectorXf::Zero(X.cols());
+		{
+			SIMPLEML_TIMER(report, "randomized_svd");
+			randomized_svd(X);
+		}
+
+		/*
+			the variances of the projections z = X * v about their means, as for
+			transform, so that the ratio to the (centered) total variance is at
+			most 1. Both come from column sums of x, x^2, z and z^2, one pass
+			over the rows, a contiguous range per job.
+		*/
+		SIMPLEML_TIMER(report, "explained_variance");
+		components = V.leftCols(n_component);
+		int d = (int)X.cols();
+		n_jobs = std::max(1, std::min(resolve_n_jobs(n_jobs), (int)X.rows()));
+		vector<ArrayXXd> partial(n_jobs);
+		parallel_for(0, (int)X.rows(), n_jobs, [&](int begin, int end, int job) {
+			// columns: sum x, sum x^2 (first d rows), sum z, sum z^2 (last n_component rows)
+			ArrayXXd& sums = partial[job];
+			sums = ArrayXXd::Zero(d + n_component, 2);
+			const int block_size = 1024;
+			for (int first = begin; first < end; first += block_size) {
+				int rows = std::min(block_size, end - first);
+				SparseRowMatrixT<float> block = X.middleRows(first, rows);
+				for (int i = 0; i < rows; i++) {
+					for (SparseRowMatrixT<float>::InnerIterator it(block, i); it; ++it) {
+						sums(it.col(), 0) += it.value();
+						sums(it.col(), 1) += (double)it.value() * it.value();
+					}
+				}
+				ArrayXXd Z = (block * components).cast<double>().array();
+				sums.col(0).tail(n_component) += Z.colwise().sum().transpose();
+				sums.col(1).tail(n_component) += Z.square().colwise().sum().transpose();
+			}
+		});
+		ArrayXXd sums = partial[0];
+		for (int job = 1; job < n_jobs; job++)
+			sums += partial[job];
+
+		double n = (double)X.rows();
+		double dof = (double)std::max((int)X.rows() - 1, 1);
+		ArrayXd variances = (sums.col(1) - sums.col(0).square() / n) / dof;
+		float total_variance = (float)variances.head(d).sum();
+		explained_variance = variances.tail(n_component).cast<float>().matrix();
+		explained_variance_ratio = explained_variance / total_variance;
 		is_fitted = true;
+		report.fit_ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
 	}
 
-	void PCA::fit_implementation(const MatrixXf& X)
+	void PCA::fit_implementation(const MatrixXf& X, int n_jobs)
 	{
 		/*
 			X = U * S * Vt
 			X: m x n, U: m x m, S: m x n, Vt: n x n
-			SVD solver: 1) Full-SVD, 2) Thin-SVD(default)
+			SVD solver: 1) Full-SVD, 2) Thin-SVD(default), 3) randomized, top components only,
+						4) covariance: eigendecomposition of the n x n covariance, no U
+			auto: covariance when m >= 10 * n, otherwise randomized when
+				  n_component is well below min(m, n), otherwise Thin-SVD
 		*/
-		JacobiSVD<MatrixXf> svd(X.rowwise() - X.colwise().mean(), ComputeThinU | ComputeThinV);
-		U = svd.matrixU();
+		mean = X.colwise().mean();
+		int min_dim = (int)std::min(X.rows(), X.cols());
+		string picked = solver;
+		if (solver == "auto") {
+			if (X.rows() >= 10 * X.cols() && X.cols() <= 4096)
+				picked = "covariance";
+			else if (min_dim > 500 && n_component < 0.8 * min_dim)
+				picked = "randomized";
+			else
+				picked = "full";
+		}
+
+		{
+			SIMPLEML_TIMER(report, picked == "covariance" ? "covariance_eigen" :
+				picked == "randomized" ? "randomized_svd" : "full_svd");
+			if (picked == "covariance") {
+				covariance_eigen(X, n_jobs);
+			}
+			else if (picked == "randomized") {
+				randomized_svd(X);
+			}
+			else {
+				JacobiSVD<MatrixXf> svd(X.rowwise() - mean, ComputeThinU | ComputeThinV);
+				U = svd.matrixU();
+				S = svd.singularValues();
+				V = svd.matrixV();
+			}
+		}
+
+		// variance along each component, and its share of the total variance
+		SIMPLEML_TIMER(report, "explained_variance");
+		float dof = (float)std::max((int)X.rows() - 1, 1);
+		float total_variance = ((X.rowwise() - mean).colwise().squaredNorm() / dof).sum();
+		components = V.leftCols(n_component);
+		explained_variance = S.head(n_component).array().square() / dof;
+		explained_variance_ratio = explained_variance / total_variance;
+	}
+
+	template<class Derived>
+	void PCA::randomized_svd(const EigenBase<Derived>& data)
+	{
+		/*
+			Halko, Martinsson & Tropp: find an orthonormal Q (m x l) whose range
+			captures the top of Xc = X - mean, then take the SVD of the small
+			l x n matrix B = Qt * Xc. Power iterations sharpen the spectrum.
+			Xc is never formed: Xc * M = X * M - 1 * (mean * M).
+		*/
+		const Derived& X = data.derived();
+		int m = (int)X.rows(), n = (int)X.cols();
+		int l = std::min(n_component + n_oversamples, std::min(m, n));
+
+		// the sketch follows from random_state, -1 draws a fresh one every fit
+		std::random_device rd;
+		std::mt19937 gen(random_state >= 0 ? (unsigned)random_state : rd());
+		std::normal_distribution<float> dist(0.f, 1.f);
+		MatrixXf omega = MatrixXf::NullaryExpr(n, l, [&]() { return dist(gen); });
+
+		auto orthonormalize = [](const MatrixXf& A) -> MatrixXf {
+			HouseholderQR<MatrixXf> qr(A);
+			return qr.householderQ() * MatrixXf::Identity(A.rows(), A.cols());
+		};
+
+		MatrixXf Y = X * omega;
+		Y.rowwise() -= mean * omega;
+		MatrixXf Q = orthonormalize(Y);
+		for (int i = 0; i < n_power_iter; i++) {
+			// Z = Xct * Q
+			MatrixXf Z = X.transpose() * Q - mean.transpose() * Q.colwise().sum();
+			Z = orthonormalize(Z);
+			Y = X * Z;
+			Y.rowwise() -= mean * Z;
+			Q = orthonormalize(Y);
+		}
+
+		MatrixXf B = Q.transpose() * X - Q.colwise().sum().transpose() * mean;
+		JacobiSVD<MatrixXf> svd(B, ComputeThinU | ComputeThinV);
+		U = Q * svd.matrixU();
 		S = svd.singularValues();
+		V = svd.matrixV();
+	}
+
+	void PCA::covariance_eigen(const MatrixXf& X, int n_jobs)
+	{
+		/*
+			Xct * Xc = V * S^2 * Vt, so the eigenvectors of the covariance are V and
+			its eigenvalues are S^2 / (m - 1). One pass over X plus an n x n
+			eigenproblem; U is not formed (fit_transform projects instead).
+		*/
+		MatrixXd cov = covariance_matrix_double(X, n_jobs);
+		SelfAdjointEigenSolver<MatrixXd> eigen(cov);
+
+		// eigenvalues come in increasing order
+		double dof = (double)std::max((int)X.rows() - 1, 1);
+		VectorXd eigenvalues = eigen.eigenvalues().reverse().cwiseMax(0.);
+		S = (eigenvalues * dof).cwiseSqrt().cast<float>();
+		V = eigen.eigenvectors().rowwise().reverse().cast<float>();
+		U.resize(0, 0);
 	}
 
 	MatrixXf PCA::transform(const MatrixXf& X)
@@ -59,17 +289,267 @@ namespace SimpleML
 			cout << "Error(PCA::transform(const MatrixXf&): The model must be fitted first." << endl;
 			exit(1);
 		}
-		if (X.rows() != U.rows()) {
+		if (X.cols() != mean.size()) {
 			cout << "Error(PCA::transform(const MatrixXf&): Incompatible feature dimension." << endl;
 			exit(1);
 		}
+		/*
+			X_new = (X - mean) * V = X * V - mean * V
+			one GEMM, rows are independent, so X may be any chunk of a stream
+		*/
+		MatrixXf projected = X * components;
+		projected.rowwise() -= mean * components;
+		if (whiten)
+			projected *= explained_variance.cwiseSqrt().cwiseInverse().asDiagonal();
+		return projected;
+	}
+
+	MatrixXf PCA::transform(const SparseRowMatrixT<float>& X)
+	{
+		// X * V less mean * V; the mean is zero after a sparse fit
+		if (!is_fitted) {
+			cout << "Error(PCA::transform(const SparseRowMatrixT<float>&): The model must be fitted first." << endl;
+			exit(1);
+		}
+		if (X.cols() != mean.size()) {
+			cout << "Error(PCA::transform(const SparseRowMatrixT<float>&): Incompatible feature dimension." << endl;
+			exit(1);
+		}
+		MatrixXf projected = X * components;
+		projected.rowwise() -= mean * components;
+		if (whiten)
+			projected *= explained_variance.cwiseSqrt().cwiseInverse().asDiagonal();
+		return projected;
+	}
+
+	MatrixXf PCA::fit_transform(const SparseRowMatrixT<float>& X, int n_jobs)
+	{
+		// X * V through transform, so that whitening uses the same explained_variance
+		fit(X, n_jobs);
+		return transform(X);
+	}
+
+	MatrixXf PCA::fit_transform(const MatrixXf& X, int n_jobs)
+	{
 		// X_new = X * V = U * S * Vt * V = U * S
-		return U.topLeftCorner(U.rows(), n_component) * S.head(n_component).asDiagonal();
+		fit(X, n_jobs);
+		if (U.rows() != X.rows())
+			return transform(X);
+		if (whiten)
+			return U.leftCols(n_component) * std::sqrt((float)std::max((int)X.rows() - 1, 1));
+		return U.leftCols(n_component) * S.head(n_component).asDiagonal();
 	}
 
-	MatrixXf PCA::fit_transform(const MatrixXf& X)
+	MatrixXf PCA::inverse_transform(const MatrixXf& Z)
 	{
-		fit_implementation(X);
-		return U.topLeftCorner(U.rows(), n_component) * S.head(n_component).asDiagonal();
+		if (!is_fitted) {
+			cout << "Error(PCA::inverse_transform(const MatrixXf&): The model must be fitted first." << endl;
+			exit(1);
+		}
+		if (Z.cols() != n_component) {
+			cout << "Error(PCA::inverse_transform(const MatrixXf&): Incompatible component dimension." << endl;
+			exit(1);
+		}
+		// X = Z * Vt + mean
+		MatrixXf restored;
+		if (whiten)
+			restored = Z * explained_variance.cwiseSqrt().asDiagonal() * components.transpose();
+		else
+			restored = Z * components.transpose();
+		restored.rowwise() += mean;
+		return restored;
+	}
+
+	const FitReport& PCA::get_fit_report() const { return report; }
+
+	IncrementalPCA::IncrementalPCA(int n_component, int batch_size) :
+		n_component(n_component), batch_size(batch_size), n_samples_seen(0) {}
+
+	void IncrementalPCA::fit(const MatrixXf& X)
+	{
+		// batch_size 0 means 5 * d rows per batch
+		int size = batch_size > 0 ? batch_size : 5 * (int)X.cols();
+		size = std::max(size, n_component);
+
+		n_samples_seen = 0;
+		for (int first = 0; first < X.rows(); first += size) {
+			int rows = std::min(size, (int)X.rows() - first);
+			// a short last batch is merged into the previous one
+			if (first + rows + n_component > X.rows() && first + rows < X.rows())
+				rows = (int)X.rows() - first;
+			partial_fit(X.middleRows(first, rows));
+			if (first + rows >= X.rows())
+				break;
+		}
+	}
+
+	void IncrementalPCA::partial_fit(const MatrixXf& X)
+	{
+		/*
+			Ross et al. (2008): the previous fit is summarized by S * Vt, so the
+			update is an SVD of the small stacked matrix
+				[ S * Vt                                    ]  k rows
+				[ X - batch_mean                            ]  m rows
+				[ sqrt(n * m / (n + m)) * (mean - batch_mean) ]  1 row
+			which never touches earlier batches.
+		*/
+		int m = (int)X.rows(), d = (int)X.cols();
+		if (n_samples_seen == 0 && (m < n_component || d < n_component)) {
+			cout << "Error(IncrementalPCA::partial_fit(const MatrixXf&)): The first batch must have ";
+			cout << "at least n_component rows and columns." << endl;
+			exit(1);
+		}
+		if (n_samples_seen > 0 && d != mean.size()) {
+			cout << "Error(IncrementalPCA::partial_fit(const MatrixXf&)): Incompatible feature dimension." << endl;
+			exit(1);
+		}
+		if (m == 0)
+			return;
+
+		RowVectorXf batch_mean = X.colwise().mean();
+		double n = (double)n_samples_seen;
+		double total = n + m;
+
+		MatrixXf stacked;
+		if (n_samples_seen == 0) {
+			stacked = X.rowwise() - batch_mean;
+			running_mean = VectorXd::Zero(d);
+			running_M2 = VectorXd::Zero(d);
+		}
+		else {
+			stacked.resize(n_component + m + 1, d);
+			stacked.topRows(n_component) = S.asDiagonal() * components.transpose();
+			stacked.middleRows(n_component, m) = X.rowwise() - batch_mean;
+			stacked.bottomRows(1) = (float)std::sqrt(n * m / total) * (mean - batch_mean);
+		}
+
+		// per-feature variance (Chan et al.) for the explained variance ratio
+		VectorXd batch_mean_d = batch_mean.transpose().cast<double>();
+		VectorXd batch_M2 = (X.cast<double>().rowwise() - batch_mean_d.transpose()).colwise().squaredNorm().transpose();
+		VectorXd delta = batch_mean_d - running_mean;
+		running_M2 += batch_M2 + delta.cwiseAbs2() * (n * m / total);
+		running_mean += delta * (m / total);
+		n_samples_seen += m;
+
+		BDCSVD<MatrixXf> svd(stacked, ComputeThinV);
+		S = svd.singularValues().head(n_component);
+		components = svd.matrixV().leftCols(n_component);
+		mean = running_mean.transpose().cast<float>();
+
+		float dof = (float)std::max(n_samples_seen - 1, 1LL);
+		explained_variance = S.array().square() / dof;
+		explained_variance_ratio = explained_variance / (float)(running_M2.sum() / dof);
+	}
+
+	MatrixXf IncrementalPCA::transform(const MatrixXf& X)
+	{
+		if (n_samples_seen == 0) {
+			cout << "Error(IncrementalPCA::transform(const MatrixXf&): The model must be fitted first." << endl;
+			exit(1);
+		}
+		if (X.cols() != mean.size()) {
+			cout << "Error(IncrementalPCA::transform(const MatrixXf&): Incompatible feature dimension." << endl;
+			exit(1);
+		}
+		MatrixXf projected = X * components;
+		projected.rowwise() -= mean * components;
+		return projected;
+	}
+
+	MatrixXf IncrementalPCA::inverse_transform(const MatrixXf& Z)
+	{
+		if (n_samples_seen == 0 || Z.cols() != n_component) {
+			cout << "Error(IncrementalPCA::inverse_transform(const MatrixXf&): Incompatible component dimension." << endl;
+			exit(1);
+		}
+		MatrixXf restored = Z * components.transpose();
+		restored.rowwise() += mean;
+		return restored;
+	}
+
+	void PCA::save(const string& path) const
+	{
+		// what transform and inverse_transform need; U (the training rows) and V are not saved
+		if (!is_fitted) {
+			cout << "Error(PCA::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		ModelWriter writer(path, "PCA", 2);
+		writer.write_int(n_component);
+		writer.write_string(solver);
+		writer.write_int(n_oversamples);
+		writer.write_int(n_power_iter);
+		writer.write_int(whiten);
+		writer.write_int(random_state);
+		writer.write_array(mean);
+		writer.write_array(components);
+		writer.write_array(S);
+		writer.write_array(explained_variance);
+		writer.write_array(explained_variance_ratio);
+		writer.close();
+	}
+
+	void PCA::load(const string& path)
+	{
+		// version 1 files have no random_state
+		ModelReader reader(path, "PCA", 2);
+		n_component = (int)reader.read_int();
+		solver = reader.read_string();
+		n_oversamples = (int)reader.read_int();
+		n_power_iter = (int)reader.read_int();
+		whiten = reader.read_int() != 0;
+		random_state = reader.model_version() >= 2 ? (int)reader.read_int() : -1;
+		reader.read_matrix(mean);
+		reader.read_matrix(components);
+		reader.read_matrix(S);
+		reader.read_matrix(explained_variance);
+		reader.read_matrix(explained_variance_ratio);
+		if (components.rows() != mean.size() || components.cols() != n_component) {
+			cout << "Error(PCA::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
+		U.resize(0, 0);
+		V.resize(0, 0);
+		is_fitted = true;
+	}
+
+	void IncrementalPCA::save(const string& path) const
+	{
+		if (n_samples_seen == 0) {
+			cout << "Error(IncrementalPCA::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		ModelWriter writer(path, "IncrementalPCA", 1);
+		writer.write_int(n_component);
+		writer.write_int(batch_size);
+		writer.write_int(n_samples_seen);
+		writer.write_array(running_mean);
+		writer.write_array(running_M2);
+		writer.write_array(S);
+		writer.write_array(mean);
+		writer.write_array(components);
+		writer.write_array(explained_variance);
+		writer.write_array(explained_variance_ratio);
+		writer.close();
+	}
+
+	void IncrementalPCA::load(const string& path)
+	{
+		// the running statistics are restored too, so partial_fit can continue
+		ModelReader reader(path, "IncrementalPCA", 1);
+		n_component = (int)reader.read_int();
+		batch_size = (int)reader.read_int();
+		n_samples_seen = reader.read_int();
+		reader.read_matrix(running_mean);
+		reader.read_matrix(running_M2);
+		reader.read_matrix(S);
+		reader.read_matrix(mean);
+		reader.read_matrix(components);
+		reader.read_matrix(explained_variance);
+		reader.read_matrix(explained_variance_ratio);
+		if (components.rows() != mean.size() || components.cols() != n_component || running_mean.size() != mean.size()) {
+			cout << "Error(IncrementalPCA::load(const string&)): Corrupt model file." << endl;
+			exit(1);
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,374 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "serialization.h"
+using namespace std;
+using namespace Eigen;
+
+namespace SimpleML
+{
+	class Ridge
+	{
+	private:
+		float alpha;
+		bool fit_intercept;
+		VectorXf coeffs;
+		float intercept;
+	public:
+		Ridge(float alpha = 1.f, bool fit_intercept = true);
+		void fit(const MatrixXf& X, const VectorXf& y);
+		MatrixXf fit_path(const MatrixXf& X, const VectorXf& y, const vector<float>& alphas);
+		VectorXf predict(const MatrixXf& X);
+		VectorXf get_coeffs() const;
+		float get_intercept() const;
+		void save(const string& path) const;
+		void load(const string& path);
+	};
+
+	class ElasticNet
+	{
+	private:
+		float alpha;
+		float l1_ratio;
+		bool fit_intercept;
+		int max_iter;
+		float tol;
+		VectorXf coeffs;
+		float intercept;
+		int n_iter;
+	public:
+		ElasticNet(float alpha = 1.f, float l1_ratio = 1.f, bool fit_intercept = true,
+			int max_iter = 1000, float tol = 1e-4f);
+		void fit(const MatrixXf& X, const VectorXf& y);
+		MatrixXf fit_path(const MatrixXf& X, const VectorXf& y, const vector<float>& alphas);
+		VectorXf predict(const MatrixXf& X);
+		VectorXf get_coeffs() const;
+		float get_intercept() const;
+		int get_n_iter() const;
+		void save(const string& path) const;
+		void load(const string& path);
+	};
+
+	void centered_gram(const MatrixXf& X, const VectorXf& y, bool fit_intercept,
+		MatrixXd& gram, VectorXd& moment, RowVectorXd& x_mean, double& y_mean);
+
+	int coordinate_descent(const MatrixXd& gram, const VectorXd& moment, double n, double l1, double l2,
+		VectorXd& w, VectorXd& Gw, const vector<bool>& screened, int max_iter, double tol);
+
+	/*---------------------------------------------------------------------------------------*/
+
+	void centered_gram(const MatrixXf& X, const VectorXf& y, bool fit_intercept,
+		MatrixXd& gram, VectorXd& moment, RowVectorXd& x_mean, double& y_mean)
+	{
+		/*
+			gram = Xct * Xc, moment = Xct * yc, where Xc and yc are centered if
+			fit_intercept. Accumulated in double a block of rows at a time, so
+			every later step only touches p x p data.
+		*/
+		int p = (int)X.cols();
+		x_mean = RowVectorXd::Zero(p);
+		y_mean = 0;
+		if (fit_intercept) {
+			x_mean = X.cast<double>().colwise().mean();
+			y_mean = y.cast<double>().mean();
+		}
+
+		gram = MatrixXd::Zero(p, p);
+		moment = VectorXd::Zero(p);
+
+		const int block_size = 4096;
+		for (int first = 0; first < X.rows(); first += block_size) {
+			int rows = std::min(block_size, (int)X.rows() - first);
+			MatrixXd block = X.middleRows(first, rows).cast<double>().rowwise() - x_mean;
+			VectorXd target = y.segment(first, rows).cast<double>().array() - y_mean;
+			gram.selfadjointView<Lower>().rankUpdate(block.transpose());
+			moment.noalias() += block.transpose() * target;
+		}
+		gram = gram.selfadjointView<Lower>();
+	}
+
+	Ridge::Ridge(float alpha, bool fit_intercept) :
+		alpha(alpha), fit_intercept(fit_intercept), intercept(0)
+	{
+		if (alpha < 0) {
+			cout << "Error(Ridge(float, bool)): alpha must be non-negative." << endl;
+			exit(1);
+		}
+	}
+
+	void Ridge::fit(const MatrixXf& X, const VectorXf& y)
+	{
+		fit_path(X, y, { alpha });
+	}
+
+	MatrixXf Ridge::fit_path(const MatrixXf& X, const VectorXf& y, const vector<float>& alphas)
+	{
+		/*
+			min ||y - Xw||^2 + alpha * ||w||^2  ->  w = (Xt * X + alpha * I)^-1 * Xt * y
+			with Xt * X = V * L * Vt, w = V * (L + alpha)^-1 * Vt * Xt * y,
+			so one p x p eigendecomposition serves every alpha.
+			Returns (p + 1) x alphas.size(); row 0 is the intercept.
+			The model keeps the solution of the last alpha.
+		*/
+		if (X.rows() != y.size()) {
+			cout << "Error(Ridge::fit_path(const MatrixXf&, const VectorXf&, const vector<float>&)): ";
+			cout << "Invalid matrix size." << endl;
+			exit(1);
+		}
+		if (alphas.empty()) {
+			cout << "Error(Ridge::fit_path(const MatrixXf&, const VectorXf&, const vector<float>&)): ";
+			cout << "Invalid argument." << endl;
+			exit(1);
+		}
+
+		MatrixXd gram;
+		VectorXd moment;
+		RowVectorXd x_mean;
+		double y_mean;
+		centered_gram(X, y, fit_intercept, gram, moment, x_mean, y_mean);
+
+		SelfAdjointEigenSolver<MatrixXd> eigen(gram);
+		VectorXd eigenvalues = eigen.eigenvalues().cwiseMax(0.);
+		VectorXd projected = eigen.eigenvectors().transpose() * moment;
+
+		int p = (int)X.cols();
+		MatrixXf path(p + 1, alphas.size());
+		for (int k = 0; k < (int)alphas.size(); k++) {
+			// alpha == 0 is plain least squares; zero eigenvalues are dropped (pseudo inverse)
+			VectorXd shrunk = projected;
+			for (int j = 0; j < p; j++) {
+				double denominator = eigenvalues[j] + alphas[k];
+				shrunk[j] = denominator > 1e-12 * eigenvalues.maxCoeff() ? shrunk[j] / denominator : 0.;
+			}
+			VectorXd w = eigen.eigenvectors() * shrunk;
+			path(0, k) = (float)(y_mean - x_mean.dot(w));
+			path.col(k).tail(p) = w.cast<float>();
+		}
+
+		alpha = alphas.back();
+		intercept = path(0, alphas.size() - 1);
+		coeffs = path.col(alphas.size() - 1).tail(p);
+		return path;
+	}
+
+	VectorXf Ridge::predict(const MatrixXf& X)
+	{
+		if (X.cols() != coeffs.size()) {
+			cout << "Error(Ridge::predict(const MatrixXf&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		return (X * coeffs).array() + intercept;
+	}
+
+	VectorXf Ridge::get_coeffs() const { return coeffs; }
+
+	float Ridge::get_intercept() const { return intercept; }
+
+	ElasticNet::ElasticNet(float alpha, float l1_ratio, bool fit_intercept, int max_iter, float tol) :
+		alpha(alpha), l1_ratio(l1_ratio), fit_intercept(fit_intercept),
+		max_iter(max_iter), tol(tol), intercept(0), n_iter(0)
+	{
+		if (alpha < 0 || l1_ratio < 0 || l1_ratio > 1) {
+			cout << "Error(ElasticNet(float, float, bool, int, float)): Invalid penalty." << endl;
+			exit(1);
+		}
+	}
+
+	void ElasticNet::fit(const MatrixXf& X, const VectorXf& y)
+	{
+		fit_path(X, y, { alpha });
+	}
+
+	MatrixXf ElasticNet::fit_path(const MatrixXf& X, const VectorXf& y, const vector<float>& alphas)
+	{
+		/*
+			min 1 / (2n) * ||y - Xw||^2 + alpha * l1_ratio * ||w||_1
+				+ alpha * (1 - l1_ratio) / 2 * ||w||^2
+			l1_ratio = 1 is the Lasso. Every alpha is warm-started from the previous
+			solution, so alphas should be decreasing. The sequential strong rule
+			screens out features before each solve, and features it wrongly dropped
+			are put back by a KKT check afterwards.
+			Returns (p + 1) x alphas.size(); row 0 is the intercept.
+			The model keeps the solution of the last alpha.
+		*/
+		if (X.rows() != y.size()) {
+			cout << "Error(ElasticNet::fit_path(const MatrixXf&, const VectorXf&, const vector<float>&)): ";
+			cout << "Invalid matrix size." << endl;
+			exit(1);
+		}
+		if (alphas.empty()) {
+			cout << "Error(ElasticNet::fit_path(const MatrixXf&, const VectorXf&, const vector<float>&)): ";
+			cout << "Invalid argument." << endl;
+			exit(1);
+		}
+
+		MatrixXd gram;
+		VectorXd moment;
+		RowVectorXd x_mean;
+		double y_mean;
+		centered_gram(X, y, fit_intercept, gram, moment, x_mean, y_mean);
+
+		int p = (int)X.cols();
+		double n = (double)X.rows();
+		VectorXd w = VectorXd::Zero(p);
+		VectorXd Gw = VectorXd::Zero(p);
+		vector<bool> screened(p, false);
+
+		// the smallest alpha with w = 0 seeds the strong rule of the first step
+		double prev_l1 = moment.cwiseAbs().maxCoeff();
+		n_iter = 0;
+
+		MatrixXf path(p + 1, alphas.size());
+		for (int k = 0; k < (int)alphas.size(); k++) {
+			double l1 = n * alphas[k] * l1_ratio;
+			double l2 = n * alphas[k] * (1 - l1_ratio);
+
+			// strong rule: |xj' * r| < 2 * l1 - prev_l1 predicts wj = 0
+			for (int j = 0; j < p; j++) {
+				double correlation = std::fabs(moment[j] - Gw[j]);
+				screened[j] = (w[j] == 0) && (correlation < 2 * l1 - prev_l1);
+			}
+
+			while (true) {
+				n_iter += coordinate_descent(gram, moment, n, l1, l2, w, Gw, screened, max_iter, tol);
+
+				// KKT: a screened feature must satisfy |xj' * r| <= l1
+				bool violated = false;
+				for (int j = 0; j < p; j++) {
+					if (screened[j] && std::fabs(moment[j] - Gw[j]) > l1) {
+						screened[j] = false;
+						violated = true;
+					}
+				}
+				if (!violated)
+					break;
+			}
+
+			prev_l1 = l1;
+			path(0, k) = (float)(y_mean - x_mean.dot(w));
+			path.col(k).tail(p) = w.cast<float>();
+		}
+
+		alpha = alphas.back();
+		intercept = path(0, alphas.size() - 1);
+		coeffs = path.col(alphas.size() - 1).tail(p);
+		return path;
+	}
+
+	int coordinate_descent(const MatrixXd& gram, const VectorXd& moment, double n, double l1, double l2,
+		VectorXd& w, VectorXd& Gw, const vector<bool>& screened, int max_iter, double tol)
+	{
+		/*
+			cyclic coordinate descent on the Gram matrix, Gw = gram * w kept in sync:
+			wj = S(moment_j - Gw_j + G_jj * wj, l1) / (G_jj + l2)
+			A full sweep finds the active set, then only the active set is cycled
+			until it converges; a final full sweep confirms nothing else moved.
+			Returns the number of sweeps.
+		*/
+		int p = (int)w.size();
+		tol *= moment.cwiseAbs().maxCoeff() / n + 1e-12;
+
+		auto sweep = [&](bool active_only) {
+			double max_change = 0;
+			for (int j = 0; j < p; j++) {
+				if (screened[j] || (active_only && w[j] == 0) || gram(j, j) == 0)
+					continue;
+				double rho = moment[j] - Gw[j] + gram(j, j) * w[j];
+				double updated = std::copysign(std::max(std::fabs(rho) - l1, 0.), rho) / (gram(j, j) + l2);
+				double change = updated - w[j];
+				if (change != 0) {
+					Gw += gram.col(j) * change;
+					w[j] = updated;
+					max_change = std::max(max_change, std::fabs(change) * gram(j, j) / n);
+				}
+			}
+			return max_change;
+		};
+
+		int iter = 0;
+		while (iter < max_iter) {
+			iter++;
+			if (sweep(false) <= tol)
+				break;
+			while (iter < max_iter) {
+				iter++;
+				if (sweep(true) <= tol)
+					break;
+			}
+		}
+		return iter;
+	}
+
+	VectorXf ElasticNet::predict(const MatrixXf& X)
+	{
+		if (X.cols() != coeffs.size()) {
+			cout << "Error(ElasticNet::predict(const MatrixXf&)): Invalid matrix size." << endl;
+			exit(1);
+		}
+		return (X * coeffs).array() + intercept;
+	}
+
+	VectorXf ElasticNet::get_coeffs() const { return coeffs; }
+
+	float ElasticNet::get_intercept() const { return intercept; }
+
+	int ElasticNet::get_n_iter() const { return n_iter; }
+
+	void Ridge::save(const string& path) const
+	{
+		if (coeffs.size() == 0) {
+			cout << "Error(Ridge::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		ModelWriter writer(path, "Ridge", 1);
+		writer.write_double(alpha);
+		writer.write_int(fit_intercept);
+		writer.write_double(intercept);
+		writer.write_array(coeffs);
+		writer.close();
+	}
+
+	void Ridge::load(const string& path)
+	{
+		ModelReader reader(path, "Ridge", 1);
+		alpha = (float)reader.read_double();
+		fit_intercept = reader.read_int() != 0;
+		intercept = (float)reader.read_double();
+		reader.read_matrix(coeffs);
+	}
+
+	void ElasticNet::save(const string& path) const
+	{
+		if (coeffs.size() == 0) {
+			cout << "Error(ElasticNet::save(const string&)): The model must be fitted first." << endl;
+			exit(1);
+		}
+		ModelWriter writer(path, "ElasticNet", 1);
+		writer.write_double(alpha);
+		writer.write_double(l1_ratio);
+		writer.write_int(fit_intercept);
+		writer.write_int(max_iter);
+		writer.write_double(tol);
+		writer.write_double(intercept);
+		writer.write_int(n_iter);
+		writer.write_array(coeffs);
+		writer.close();
+	}
+
+	void ElasticNet::load(const string& path)
+	{
+		ModelReader reader(path, "ElasticNet", 1);
+		alpha = (float)reader.read_double();
+		l1_ratio = (float)reader.read_double();
+		fit_intercept = reader.read_int() != 0;
+		max_iter = (int)reader.read_int();
+		tol = (float)reader.read_double();
+		intercept = (float)reader.read_double();
+		n_iter = (int)reader.read_int();
+		reader.read_matrix(coeffs);
+	}
+}
@@ -0,0 +1,356 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <Eigen/Dense>
+using namespace std;
+using namespace Eigen;
+
+namespace SimpleML
+{
+	/*
+		Binary model files (POSIX, the reader maps the whole file with mmap):
+
+			"SIMPLEML" | u32 format version | string model | u32 model version | fields
+
+		Numbers are little-endian, strings are a u64 length and the bytes. An
+		array is u32 element type, u32 row-major flag, i64 rows, i64 cols and
+		then, at the next multiple of 64 bytes, the raw elements. On a
+		little-endian host an array of the requested element type is returned
+		as a pointer into the mapping, so it is neither read nor copied until
+		it is touched. Otherwise (big-endian host, or e.g. a double model loaded
+		as float) it is converted into a buffer owned by the MappedFile.
+	*/
+	const uint32_t model_format_version = 1;
+
+	class MappedFile
+	{
+	private:
+		string path;
+		char* base;
+		size_t length;
+		vector<unique_ptr<char[]>> converted;	// arrays that could not be used in place
+	public:
+		MappedFile(const string& path);
+		~MappedFile();
+		MappedFile(const MappedFile& other) = delete;
+		MappedFile& operator=(const MappedFile& other) = delete;
+		const char* data() const;
+		size_t size() const;
+		const string& name() const;
+		char* allocate(size_t bytes);
+	};
+
+	class ModelWriter
+	{
+	private:
+		string path;
+		ofstream out;
+		size_t offset;
+	public:
+		ModelWriter(const string& path, const string& model, uint32_t version);
+		void write_int(long long value);
+		void write_double(double value);
+		void write_string(const string& value);
+		template<class T>
+		void write_array(const T* data, Index rows, Index cols, bool row_major);
+		template<class Derived>
+		void write_array(const PlainObjectBase<Derived>& array);
+		void close();
+	private:
+		template<class T>
+		void write_value(T value);
+		void write_bytes(const void* data, size_t size);
+	};
+
+	class ModelReader
+	{
+	private:
+		shared_ptr<MappedFile> file;
+		size_t offset;
+		uint32_t version;
+	public:
+		ModelReader(const string& path, const string& model, uint32_t max_version);
+		uint32_t model_version() const;
+		shared_ptr<MappedFile> mapping() const;
+		long long read_int();
+		double read_double();
+		string read_string();
+		template<class T>
+		const T* read_array(Index& rows, Index& cols, bool row_major);
+		template<class MatrixType>
+		void read_matrix(MatrixType& matrix);
+	private:
+		template<class T>
+		T read_value();
+		const char* read_bytes(size_t size);
+		void fail(const string& message) const;
+	};
+
+	template<class T>
+	uint32_t element_type();
+
+	bool is_little_endian();
+
+	/*---------------------------------------------------------------------------------------*/
+
+	template<>
+	uint32_t element_type<float>() { return 1; }
+
+	template<>
+	uint32_t element_type<double>() { return 2; }
+
+	template<>
+	uint32_t element_type<int>() { return 3; }
+
+	bool is_little_endian()
+	{
+		uint16_t probe = 1;
+		unsigned char first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
+
+	MappedFile::MappedFile(const string& path) : path(path), base(nullptr), length(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			cout << "Error(MappedFile(const string&)): Cannot open " << path << "." << endl;
+			exit(1);
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			cout << "Error(MappedFile(const string&)): " << path << " is empty." << endl;
+			exit(1);
+		}
+		length = (size_t)info.st_size;
+		void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED) {
+			cout << "Error(MappedFile(const string&)): Cannot map " << path << "." << endl;
+			exit(1);
+		}
+		base = (char*)address;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (base != nullptr)
+			munmap(base, length);
+	}
+
+	const char* MappedFile::data() const { return base; }
+
+	size_t MappedFile::size() const { return length; }
+
+	const string& MappedFile::name() const { return path; }
+
+	char* MappedFile::allocate(size_t bytes)
+	{
+		converted.emplace_back(new char[std::max(bytes, (size_t)1)]);
+		return converted.back().get();
+	}
+
+	ModelWriter::ModelWriter(const string& path, const string& model, uint32_t version) :
+		path(path), out(path, ios::binary | ios::trunc), offset(0)
+	{
+		if (!out) {
+			cout << "Error(ModelWriter(const string&, const string&, uint32_t)): Cannot open " << path << "." << endl;
+			exit(1);
+		}
+		write_bytes("SIMPLEML", 8);
+		write_value<uint32_t>(model_format_version);
+		write_string(model);
+		write_value<uint32_t>(version);
+	}
+
+	template<class T>
+	void ModelWriter::write_value(T value)
+	{
+		unsigned char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		if (!is_little_endian())
+			std::reverse(bytes, bytes + sizeof(T));
+		write_bytes(bytes, sizeof(T));
+	}
+
+	void ModelWriter::write_bytes(const void* data, size_t size)
+	{
+		out.write((const char*)data, size);
+		offset += size;
+	}
+
+	void ModelWriter::write_int(long long value) { write_value<int64_t>(value); }
+
+	void ModelWriter::write_double(double value) { write_value<double>(value); }
+
+	void ModelWriter::write_string(const string& value)
+	{
+		write_value<uint64_t>(value.size());
+		write_bytes(value.data(), value.size());
+	}
+
+	template<class T>
+	void ModelWriter::write_array(const T* data, Index rows, Index cols, bool row_major)
+	{
+		write_value<uint32_t>(element_type<T>());
+		write_value<uint32_t>(row_major ? 1 : 0);
+		write_value<int64_t>(rows);
+		write_value<int64_t>(cols);
+
+		// the elements start 64-byte aligned, so a mapped array is aligned as well
+		static const char padding[64] = {};
+		write_bytes(padding, (64 - offset % 64) % 64);
+		size_t count = (size_t)rows * cols;
+		if (is_little_endian()) {
+			write_bytes(data, count * sizeof(T));
+		}
+		else {
+			for (size_t i = 0; i < count; i++)
+				write_value<T>(data[i]);
+		}
+	}
+
+	template<class Derived>
+	void ModelWriter::write_array(const PlainObjectBase<Derived>& array)
+	{
+		write_array(array.data(), array.rows(), array.cols(), (bool)Derived::IsRowMajor);
+	}
+
+	void ModelWriter::close()
+	{
+		out.close();
+		if (out.fail()) {
+			cout << "Error(ModelWriter::close()): Cannot write " << path << "." << endl;
+			exit(1);
+		}
+	}
+
+	ModelReader::ModelReader(const string& path, const string& model, uint32_t max_version) :
+		file(make_shared<MappedFile>(path)), offset(0), version(0)
+	{
+		if (file->size() < 8 || std::memcmp(read_bytes(8), "SIMPLEML", 8) != 0)
+			fail("Not a SimpleML model file");
+		if (read_value<uint32_t>() > model_format_version)
+			fail("Written by a newer version of SimpleML");
+		string stored = read_string();
+		if (stored != model)
+			fail("Holds a " + stored + " model, not a " + model);
+		version = read_value<uint32_t>();
+		if (version > max_version)
+			fail("Written by a newer version of " + model);
+	}
+
+	uint32_t ModelReader::model_version() const { return version; }
+
+	shared_ptr<MappedFile> ModelReader::mapping() const { return file; }
+
+	void ModelReader::fail(const string& message) const
+	{
+		cout << "Error(ModelReader(const string&, const string&, uint32_t)): " << file->name() << ": " << message << "." << endl;
+		exit(1);
+	}
+
+	const char* ModelReader::read_bytes(size_t size)
+	{
+		if (size > file->size() - offset)
+			fail("Truncated file");
+		const char* bytes = file->data() + offset;
+		offset += size;
+		return bytes;
+	}
+
+	template<class T>
+	T ModelReader::read_value()
+	{
+		unsigned char bytes[sizeof(T)];
+		std::memcpy(bytes, read_bytes(sizeof(T)), sizeof(T));
+		if (!is_little_endian())
+			std::reverse(bytes, bytes + sizeof(T));
+		T value;
+		std::memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	long long ModelReader::read_int() { return read_value<int64_t>(); }
+
+	double ModelReader::read_double() { return read_value<double>(); }
+
+	string ModelReader::read_string()
+	{
+		uint64_t size = read_value<uint64_t>();
+		const char* bytes = read_bytes(size);
+		return string(bytes, size);
+	}
+
+	template<class T>
+	const T* ModelReader::read_array(Index& rows, Index& cols, bool row_major)
+	{
+		// a pointer into the mapping, or into a converted copy owned by it
+		uint32_t type = read_value<uint32_t>();
+		bool stored_row_major = read_value<uint32_t>() != 0;
+		int64_t stored_rows = read_value<int64_t>();
+		int64_t stored_cols = read_value<int64_t>();
+		if (stored_rows < 0 || stored_cols < 0 || type < 1 || type > 3)
+			fail("Corrupt array header");
+		rows = (Index)stored_rows;
+		cols = (Index)stored_cols;
+		if (stored_row_major != row_major && rows > 1 && cols > 1)
+			fail("Unexpected storage order");
+
+		size_t count = (size_t)rows * cols;
+		size_t width = type == 2 ? 8 : 4;
+		read_bytes((64 - offset % 64) % 64);
+		if (count > (file->size() - offset) / width)
+			fail("Truncated file");
+		const char* data = read_bytes(count * width);
+		if (type == element_type<T>() && is_little_endian())
+			return (const T*)data;
+
+		T* copy = (T*)file->allocate(count * sizeof(T));
+		for (size_t i = 0; i < count; i++) {
+			unsigned char bytes[8];
+			std::memcpy(bytes, data + i * width, width);
+			if (!is_little_endian())
+				std::reverse(bytes, bytes + width);
+			if (type == 1) {
+				float value;
+				std::memcpy(&value, bytes, 4);
+				copy[i] = (T)value;
+			}
+			else if (type == 2) {
+				double value;
+				std::memcpy(&value, bytes, 8);
+				copy[i] = (T)value;
+			}
+			else {
+				int32_t value;
+				std::memcpy(&value, bytes, 4);
+				copy[i] = (T)value;
+			}
+		}
+		return copy;
+	}
+
+	template<class MatrixType>
+	void ModelReader::read_matrix(MatrixType& matrix)
+	{
+		// for small arrays the model owns: copied out of the mapping
+		typedef typename MatrixType::Scalar T;
+		Index rows, cols;
+		const T* data = read_array<T>(rows, cols, (bool)MatrixType::IsRowMajor);
+		if ((MatrixType::RowsAtCompileTime == 1 && rows != 1) || (MatrixType::ColsAtCompileTime == 1 && cols != 1))
+			fail("Unexpected array shape");
+		matrix = Map<const MatrixType>(data, rows, cols);
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "parallel.h"
+using namespace std;
+using namespace Eigen;
+
+namespace SimpleML
+{
+	/*
+		Deterministic generators for benchmarks and tests. Rows are produced in
+		fixed blocks, each with its own generator seeded from (seed, block), so
+		the data depends on the seed only (not on n_jobs) and large datasets
+		are generated in parallel. Only the raw mt19937 output is used, which
+		is the same with every compiler and standard library.
+	*/
+	class RandomStream
+	{
+	private:
+		std::mt19937 gen;
+		bool has_spare;
+		float spare;
+	public:
+		RandomStream(unsigned seed, unsigned stream);
+		float uniform();
+		float normal();
+	};
+
+	void make_blobs(int N, int d, int K, MatrixXf& X, VectorXi& Y, unsigned seed = 0,
+		float cluster_std = 1.f, float center_box = 10.f, int n_jobs = 1);
+
+	void make_classification(int N, int d, int K, MatrixXf& X, VectorXi& Y, unsigned seed = 0, int n_jobs = 1);
+
+	void make_regression(int N, int d, MatrixXf& X, VectorXf& y, VectorXf& coeffs, unsigned seed = 0,
+		float noise = 0.1f, int n_jobs = 1);
+
+	template<class F>
+	void generate_blocks(int N, unsigned seed, int n_jobs, F f);
+
+	/*---------------------------------------------------------------------------------------*/
+
+	RandomStream::RandomStream(unsigned seed, unsigned stream) : has_spare(false), spare(0)
+	{
+		std::seed_seq sequence{ seed, stream };
+		gen.seed(sequence);
+	}
+
+	float RandomStream::uniform()
+	{
+		// (0, 1), never 0 so log() below stays finite
+		return (float)((gen() + 0.5) / 4294967296.0);
+	}
+
+	float RandomStream::normal()
+	{
+		// Box-Muller, the second value is kept for the next call
+		if (has_spare) {
+			has_spare = false;
+			return spare;
+		}
+		double radius = std::sqrt(-2. * std::log((double)uniform()));
+		double angle = 2. * 3.14159265358979323846 * uniform();
+		spare = (float)(radius * std::sin(angle));
+		has_spare = true;
+		return (float)(radius * std::cos(angle));
+	}
+
+	template<class F>
+	void generate_blocks(int N, unsigned seed, int n_jobs, F f)
+	{
+		// f(first, rows, stream) fills rows [first, first + rows) from its own stream
+		const int block_size = 4096;
+		int n_block = (N + block_size - 1) / block_size;
+		parallel_for(0, n_block, n_jobs, [&](int begin, int end, int /*job*/) {
+			for (int b = begin; b < end; b++) {
+				RandomStream stream(seed, (unsigned)b + 1);
+				f(b * block_size, std::min(block_size, N - b * block_size), stream);
+			}
+		});
+	}
+
+	void make_blobs(int N, int d, int K, MatrixXf& X, VectorXi& Y, unsigned seed,
+		float cluster_std, float center_box, int n_jobs)
+	{
+		// K isotropic Gaussian clusters, centers uniform in [-center_box, center_box]^d, labels round-robin
+		if (N < 1 || d < 1 || K < 1) {
+			cout << "Error(make_blobs(int, int, int, MatrixXf&, VectorXi&, unsigned, float, float, int)): ";
+			cout << "Invalid size." << endl;
+			exit(1);
+		}
+		RandomStream center_stream(seed, 0);
+		MatrixXf centers(K, d);
+		for (int k = 0; k < K; k++) {
+			for (int j = 0; j < d; j++)
+				centers(k, j) = center_box * (2.f * center_stream.uniform() - 1.f);
+		}
+
+		X.resize(N, d);
+		Y.resize(N);
+		generate_blocks(N, seed, n_jobs, [&](int first, int rows, RandomStream& stream) {
+			for (int i = first; i < first + rows; i++) {
+				Y[i] = i % K;
+				for (int j = 0; j < d; j++)
+					X(i, j) = centers(Y[i], j) + cluster_std * stream.normal();
+			}
+		});
+	}
+
+	void make_classification(int N, int d, int K, MatrixXf& X, VectorXi& Y, unsigned seed, int n_jobs)
+	{
+		/*
+			X ~ N(0, I), Y = argmax_k(x * W_k) for a random d x K matrix W, so the
+			classes are linearly separable (but not axis aligned).
+		*/
+		if (N < 1 || d < 1 || K < 2) {
+			cout << "Error(make_classification(int, int, int, MatrixXf&, VectorXi&, unsigned, int)): ";
+			cout << "Invalid size." << endl;
+			exit(1);
+		}
+		RandomStream weight_stream(seed, 0);
+		MatrixXf W(d, K);
+		for (int j = 0; j < d; j++) {
+			for (int k = 0; k < K; k++)
+				W(j, k) = weight_stream.normal();
+		}
+
+		X.resize(N, d);
+		Y.resize(N);
+		generate_blocks(N, seed, n_jobs, [&](int first, int rows, RandomStream& stream) {
+			for (int i = first; i < first + rows; i++) {
+				for (int j = 0; j < d; j++)
+					X(i, j) = stream.normal();
+			}
+			MatrixXf scores = X.middleRows(first, rows) * W;
+			for (int i = 0; i < rows; i++) {
+				Index k;
+				scores.row(i).maxCoeff(&k);
+				Y[first + i] = (int)k;
+			}
+		});
+	}
+
+	void make_regression(int N, int d, MatrixXf& X, VectorXf& y, VectorXf& coeffs, unsigned seed,
+		float noise, int n_jobs)
+	{
+		// y = X * coeffs + noise * N(0, 1), X ~ N(0, I), coeffs ~ N(0, 1)
+		if (N < 1 || d < 1) {
+			cout << "Error(make_regression(int, int, MatrixXf&, VectorXf&, VectorXf&, unsigned, float, int)): ";
+			cout << "Invalid size." << endl;
+			exit(1);
+		}
+		RandomStream coeff_stream(seed, 0);
+		coeffs.resize(d);
+		for (int j = 0; j < d; j++)
+			coeffs[j] = coeff_stream.normal();
+
+		X.resize(N, d);
+		y.resize(N);
+		generate_blocks(N, seed, n_jobs, [&](int first, int rows, RandomStream& stream) {
+			for (int i = first; i < first + rows; i++) {
+				for (int j = 0; j < d; j++)
+					X(i, j) = stream.normal();
+				y[i] = X.row(i).dot(coeffs) + noise * stream.normal();
+			}
+		});
+	}
+}
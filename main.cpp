@@ -11,6 +11,7 @@
 #include "./headers/k_means.h"
 #include "./headers/gaussian_mixture.h"
 #include "./headers/ordinary_least_squares.h"
+#include "./headers/regularized_regression.h"
 using namespace std;
 using namespace Eigen;
 
@@ -38,6 +39,12 @@ int main()
 	// K-fold cross validation. Uncomment below if necessary
 	/*float acc = SimpleML::evaluate_classification_model(dt, X, Y, 5);
 	cout << "Accuracy(k-fold): " << acc * 100 << "%" << endl;*/
+
+	// Stratified, seeded folds with per-fold accuracy and fit/predict times (ms)
+	/*vector<vector<int>> folds = SimpleML::stratified_k_fold(Y, 5, 42);
+	SimpleML::CrossValidationResult result = SimpleML::evaluate_classification_model(dt, X, Y, folds);
+	for (int i = 0; i < folds.size(); i++)
+		cout << "fold " << i << ": " << result.accuracies[i] << " " << result.fit_times[i] << "ms" << endl;*/
 }
 
 //// naive bayes
@@ -111,9 +118,11 @@ int main()
 //		X = SimpleML::add_constant(X);
 //	}
 //
-//	// run OLS.
+//	// run OLS. solver: "auto"(default), "cholesky", "ldlt", "qr", "bdcsvd", "jacobi".
+//	// Y may also be a MatrixXf with one target per column.
 //	SimpleML::OLS ols;
 //	ols.fit(X, Y);
+//	cout << "OLS coefficients: " << ols.get_coeffs().transpose() << endl;
 //	
 //	// predict
 //	VectorXf predicted = ols.predict(X);
@@ -123,6 +132,34 @@ int main()
 //	return 0;
 //}
 
+//// lasso regularization path
+//int main()
+//{
+//	string file_name = "./dataset/winequality-white.csv";
+//
+//	MatrixXf X;
+//	VectorXf Y;
+//
+//	// read csv
+//	SimpleML::read_csv(file_name, X, Y);
+//
+//	// decreasing alphas, each fit is warm-started from the previous one
+//	vector<float> alphas;
+//	for (int i = 0; i < 100; i++) {
+//		alphas.push_back(std::pow(10.f, -4.f * i / 99.f));
+//	}
+//
+//	// run lasso (l1_ratio = 1). Use SimpleML::Ridge for an L2 penalty.
+//	SimpleML::ElasticNet lasso(1.f, 1.f);
+//	MatrixXf path = lasso.fit_path(X, Y, alphas);
+//
+//	// row 0 is the intercept, one column per alpha
+//	cout << "Coefficients at the smallest alpha:" << endl;
+//	cout << path.col(alphas.size() - 1).transpose() << endl;
+//
+//	return 0;
+//}
+
 //// gaussian mixture
 //int main()
 //{
@@ -136,7 +173,14 @@ int main()
 //
 //	// run gaussian mixture model
 //	SimpleML::GaussianMixture gm(3);
+//	gm.set_callback([](const SimpleML::FitReport& report) {
+//		cout << "Epoch " << report.n_iter << " --> log-likelihood: " << report.history.back() << endl;
+//	});
 //	gm.fit(X);
+//	cout << "Phi: " << gm.get_phi() << endl;
+//
+//	// fit time and iterations; phase timers and counters with -DSIMPLEML_PROFILE
+//	gm.get_fit_report().print();
 //
 //	// evaluate
 //	vector<vector<int>> predicted = gm.predict(X);
@@ -0,0 +1,271 @@
+/*
+	Serves a saved model over a Unix domain socket. Concurrent single-row
+	requests are coalesced into micro-batches (see MicroBatcher) and every
+	batch is one predict call on a worker thread. p50/p99 latency, throughput
+	and the mean batch size are printed every report interval and at exit.
+	The wire format is described in server/protocol.h.
+
+	g++ server/inference_server.cpp --std=c++17 -O2 -pthread -o inference_server
+	./inference_server --model=tree --path=tree.bin --d=20 --socket=/tmp/simpleml.sock
+	./inference_server --model=knn --path=knn.bin --d=20 --max-batch=128 --max-delay-us=500 --workers=2
+
+	Options (defaults in brackets)
+		--model            knn, kmeans, gmm, tree, naive_bayes, ols, incremental_ols,
+		                   ridge, elastic_net, pca or incremental_pca
+		--path             file written by the model's save
+		--d                features per row the model was fitted on
+		--socket           socket path, replaced if it exists [/tmp/simpleml.sock]
+		--max-batch        rows per predict call at most [64]
+		--max-delay-us     longest a request waits for its batch to fill [1000]
+		--workers          batches predicted at the same time [1]
+		--n-jobs           n_jobs of every predict call, for the models that take it [1]
+		--report-interval  seconds between reports, 0 for the final report only [5]
+
+	Labels (classifiers, cluster indices) are returned as one float per row;
+	ols returns one value per target and pca one value per component. predict
+	only reads the model, so the workers share one instance. Stop with Ctrl-C.
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <Eigen/Dense>
+#include "protocol.h"
+#include "../headers/micro_batching.h"
+#include "../headers/k_nearest_neighbors.h"
+#include "../headers/k_means.h"
+#include "../headers/gaussian_mixture.h"
+#include "../headers/decision_tree.h"
+#include "../headers/naive_bayes.h"
+#include "../headers/ordinary_least_squares.h"
+#include "../headers/regularized_regression.h"
+#include "../headers/principal_component_analysis.h"
+using namespace std;
+using namespace Eigen;
+
+struct Config
+{
+	string model;
+	string path;
+	int d = 0;
+	string socket = "/tmp/simpleml.sock";
+	int max_batch = 64;
+	int max_delay_us = 1000;
+	int workers = 1;
+	int n_jobs = 1;
+	double report_interval = 5;
+};
+
+struct Connection
+{
+	int fd;
+	mutex write_lock;
+	Connection(int fd) : fd(fd) {}
+	~Connection() { close(fd); }
+};
+
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int) { stop_requested = 1; }
+
+MatrixXf labels_of(const vector<vector<int>>& clusters, int n)
+{
+	MatrixXf labels(n, 1);
+	for (int k = 0; k < (int)clusters.size(); k++) {
+		for (int i : clusters[k])
+			labels(i, 0) = (float)k;
+	}
+	return labels;
+}
+
+SimpleML::BatchPredictor load_model(const Config& config)
+{
+	// the model lives as long as the returned predictor
+	const string& type = config.model;
+	int n_jobs = config.n_jobs;
+	if (type == "knn") {
+		auto model = make_shared<SimpleML::KNN>(1);
+		model->load(config.path);
+		return [model, n_jobs](const MatrixXf& X) { return MatrixXf(model->predict(X, n_jobs).cast<float>()); };
+	}
+	if (type == "kmeans") {
+		auto model = make_shared<SimpleML::KMeans>(1);
+		model->load(config.path);
+		return [model, n_jobs](const MatrixXf& X) { return labels_of(model->predict(X, n_jobs), (int)X.rows()); };
+	}
+	if (type == "gmm") {
+		auto model = make_shared<SimpleML::GaussianMixture>(1);
+		model->load(config.path);
+		return [model, n_jobs](const MatrixXf& X) { return labels_of(model->predict(X, n_jobs), (int)X.rows()); };
+	}
+	if (type == "tree") {
+		auto model = make_shared<SimpleML::DecisionTree>();
+		model->load(config.path);
+		return [model, n_jobs](const MatrixXf& X) { return MatrixXf(model->predict(X, n_jobs).cast<float>()); };
+	}
+	if (type == "naive_bayes") {
+		auto model = make_shared<SimpleML::NaiveBayes>();
+		model->load(config.path);
+		return [model, n_jobs](const MatrixXf& X) { return MatrixXf(model->predict(X, n_jobs).cast<float>()); };
+	}
+	if (type == "ols") {
+		auto model = make_shared<SimpleML::OLS>();
+		model->load(config.path);
+		return [model](const MatrixXf& X) { return model->predict(X); };
+	}
+	if (type == "incremental_ols") {
+		auto model = make_shared<SimpleML::IncrementalOLS>();
+		model->load(config.path);
+		return [model](const MatrixXf& X) { return MatrixXf(model->predict(X)); };
+	}
+	if (type == "ridge") {
+		auto model = make_shared<SimpleML::Ridge>();
+		model->load(config.path);
+		return [model](const MatrixXf& X) { return MatrixXf(model->predict(X)); };
+	}
+	if (type == "elastic_net") {
+		auto model = make_shared<SimpleML::ElasticNet>();
+		model->load(config.path);
+		return [model](const MatrixXf& X) { return MatrixXf(model->predict(X)); };
+	}
+	if (type == "pca") {
+		auto model = make_shared<SimpleML::PCA>(1);
+		model->load(config.path);
+		return [model](const MatrixXf& X) { return model->transform(X); };
+	}
+	if (type == "incremental_pca") {
+		auto model = make_shared<SimpleML::IncrementalPCA>(1);
+		model->load(config.path);
+		return [model](const MatrixXf& X) { return model->transform(X); };
+	}
+	cerr << "Unknown model " << type << " (see the comment at the top of server/inference_server.cpp)" << endl;
+	exit(1);
+}
+
+void serve_connection(shared_ptr<Connection> connection, SimpleML::MicroBatcher& batcher, uint32_t n_features,
+	uint32_t n_outputs)
+{
+	// reads requests until the client closes; replies are written by the batch workers
+	uint32_t hello[2] = { n_features, n_outputs };
+	if (!SimpleML::write_all(connection->fd, hello, sizeof(hello)))
+		return;
+
+	vector<float> row(n_features);
+	uint32_t id;
+	while (SimpleML::read_exact(connection->fd, &id, sizeof(id)) &&
+		SimpleML::read_exact(connection->fd, row.data(), n_features * sizeof(float))) {
+		batcher.submit(row.data(), [connection, id](const float* output, int n_output) {
+			vector<char> reply(sizeof(uint32_t) + n_output * sizeof(float));
+			std::memcpy(reply.data(), &id, sizeof(uint32_t));
+			std::memcpy(reply.data() + sizeof(uint32_t), output, n_output * sizeof(float));
+			unique_lock<mutex> guard(connection->write_lock);
+			SimpleML::write_all(connection->fd, reply.data(), reply.size());
+		});
+	}
+}
+
+void print_report(const SimpleML::BatchWindowStats& stats)
+{
+	cout << fixed << setprecision(1) << setw(10) << stats.requests << setw(12) << stats.throughput() <<
+		setw(10) << stats.batches << setw(12) << stats.mean_batch() << setw(12) << stats.percentile(0.5) <<
+		setw(12) << stats.percentile(0.99) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	Config config;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+		if (key == "--model") config.model = value;
+		else if (key == "--path") config.path = value;
+		else if (key == "--d") config.d = stoi(value);
+		else if (key == "--socket") config.socket = value;
+		else if (key == "--max-batch") config.max_batch = stoi(value);
+		else if (key == "--max-delay-us") config.max_delay_us = stoi(value);
+		else if (key == "--workers") config.workers = stoi(value);
+		else if (key == "--n-jobs") config.n_jobs = stoi(value);
+		else if (key == "--report-interval") config.report_interval = stod(value);
+		else {
+			cerr << "Unknown option " << arg << " (see the comment at the top of server/inference_server.cpp)" << endl;
+			return 1;
+		}
+	}
+	if (config.model.empty() || config.path.empty() || config.d < 1) {
+		cerr << "--model, --path and --d are required (see the comment at the top of server/inference_server.cpp)" << endl;
+		return 1;
+	}
+
+	// one row through the model checks d and gives the width of a reply
+	SimpleML::BatchPredictor predictor = load_model(config);
+	uint32_t n_outputs = (uint32_t)predictor(MatrixXf::Zero(1, config.d)).cols();
+
+	sockaddr_un address;
+	if (!SimpleML::make_address(config.socket, address)) {
+		cerr << "Error(main): Invalid socket path " << config.socket << "." << endl;
+		return 1;
+	}
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(config.socket.c_str());
+	if (listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+		cerr << "Error(main): Cannot listen on " << config.socket << "." << endl;
+		return 1;
+	}
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
+
+	SimpleML::MicroBatcher batcher(config.d, predictor, config.max_batch, config.max_delay_us, config.workers);
+	cout << config.model << " model from " << config.path << " on " << config.socket << ", d = " << config.d <<
+		", max batch = " << config.max_batch << ", max delay = " << config.max_delay_us << " us, workers = " <<
+		config.workers << endl;
+	cout << setw(10) << "requests" << setw(12) << "req/s" << setw(10) << "batches" << setw(12) << "mean batch" <<
+		setw(12) << "p50(us)" << setw(12) << "p99(us)" << endl;
+
+	SimpleML::BatchWindowStats total;
+	auto last_report = chrono::steady_clock::now();
+	auto add_window = [&]() {
+		SimpleML::BatchWindowStats stats = batcher.take_stats();
+		total.requests += stats.requests;
+		total.batches += stats.batches;
+		total.seconds += stats.seconds;
+		total.latencies_us.insert(total.latencies_us.end(), stats.latencies_us.begin(), stats.latencies_us.end());
+		return stats;
+	};
+
+	while (!stop_requested) {
+		pollfd waiting = { listener, POLLIN, 0 };
+		if (poll(&waiting, 1, 100) > 0) {
+			int fd = accept(listener, nullptr, nullptr);
+			if (fd >= 0) {
+				thread(serve_connection, make_shared<Connection>(fd), std::ref(batcher), (uint32_t)config.d, n_outputs).detach();
+			}
+		}
+		double since = chrono::duration<double>(chrono::steady_clock::now() - last_report).count();
+		if (config.report_interval > 0 && since >= config.report_interval) {
+			SimpleML::BatchWindowStats stats = add_window();
+			if (stats.requests > 0)
+				print_report(stats);
+			last_report = chrono::steady_clock::now();
+		}
+	}
+
+	// answer what is queued, then report over the whole run
+	close(listener);
+	unlink(config.socket.c_str());
+	batcher.shutdown();
+	add_window();
+	cout << "total" << endl;
+	print_report(total);
+	cout.flush();
+	_exit(0);
+}
@@ -0,0 +1,166 @@
+/*
+	Load generator for inference_server. Every connection runs on its own
+	thread and keeps --pipeline requests in flight, sending the next one as
+	soon as a reply comes back (closed loop). Rows are drawn from a standard
+	normal distribution. Prints the end-to-end p50/p99/max latency and the
+	throughput over all connections.
+
+	g++ server/load_generator.cpp --std=c++17 -O2 -pthread -o load_generator
+	./load_generator --socket=/tmp/simpleml.sock --connections=16 --requests=200000
+	./load_generator --connections=1 --pipeline=1     (unbatched baseline: one request at a time)
+
+	Options (defaults in brackets)
+		--socket       socket path of the server [/tmp/simpleml.sock]
+		--connections  concurrent clients [8]
+		--requests     requests over all connections [100000]
+		--pipeline     requests in flight per connection [1]
+		--seed         generator seed [42]
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.h"
+using namespace std;
+
+struct Config
+{
+	string socket = "/tmp/simpleml.sock";
+	int connections = 8;
+	long long requests = 100000;
+	int pipeline = 1;
+	unsigned seed = 42;
+};
+
+struct ClientResult
+{
+	vector<double> latencies_us;
+	bool failed = false;
+};
+
+void run_client(const Config& config, long long n_request, unsigned seed, ClientResult& result)
+{
+	sockaddr_un address;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || !SimpleML::make_address(config.socket, address) || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+		result.failed = true;
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+	uint32_t hello[2];
+	if (!SimpleML::read_exact(fd, hello, sizeof(hello))) {
+		result.failed = true;
+		close(fd);
+		return;
+	}
+	uint32_t n_features = hello[0], n_outputs = hello[1];
+
+	mt19937 gen(seed);
+	normal_distribution<float> normal(0.f, 1.f);
+	vector<char> request(sizeof(uint32_t) + n_features * sizeof(float));
+	vector<char> reply(sizeof(uint32_t) + n_outputs * sizeof(float));
+	vector<float> row(n_features);
+
+	// the id is the index of the request, so its send time is found without a map
+	vector<chrono::steady_clock::time_point> sent(n_request);
+	auto send_next = [&](uint32_t id) {
+		for (float& value : row)
+			value = normal(gen);
+		std::memcpy(request.data(), &id, sizeof(uint32_t));
+		std::memcpy(request.data() + sizeof(uint32_t), row.data(), n_features * sizeof(float));
+		sent[id] = chrono::steady_clock::now();
+		return SimpleML::write_all(fd, request.data(), request.size());
+	};
+
+	long long n_sent = 0;
+	while (n_sent < std::min((long long)config.pipeline, n_request)) {
+		if (!send_next((uint32_t)n_sent++)) {
+			result.failed = true;
+			close(fd);
+			return;
+		}
+	}
+	result.latencies_us.reserve(n_request);
+	for (long long received = 0; received < n_request; received++) {
+		if (!SimpleML::read_exact(fd, reply.data(), reply.size())) {
+			result.failed = true;
+			break;
+		}
+		uint32_t id;
+		std::memcpy(&id, reply.data(), sizeof(uint32_t));
+		if (id >= n_sent) {
+			result.failed = true;
+			break;
+		}
+		result.latencies_us.push_back(chrono::duration<double, std::micro>(chrono::steady_clock::now() - sent[id]).count());
+		if (n_sent < n_request && !send_next((uint32_t)n_sent++)) {
+			result.failed = true;
+			break;
+		}
+	}
+	close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+	Config config;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		size_t eq = arg.find('=');
+		string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+		if (key == "--socket") config.socket = value;
+		else if (key == "--connections") config.connections = stoi(value);
+		else if (key == "--requests") config.requests = stoll(value);
+		else if (key == "--pipeline") config.pipeline = stoi(value);
+		else if (key == "--seed") config.seed = (unsigned)stoul(value);
+		else {
+			cerr << "Unknown option " << arg << " (see the comment at the top of server/load_generator.cpp)" << endl;
+			return 1;
+		}
+	}
+	if (config.connections < 1 || config.pipeline < 1 || config.requests < config.connections) {
+		cerr << "Need --connections >= 1, --pipeline >= 1 and --requests >= --connections." << endl;
+		return 1;
+	}
+
+	vector<ClientResult> results(config.connections);
+	vector<thread> clients;
+	auto start = chrono::steady_clock::now();
+	for (int c = 0; c < config.connections; c++) {
+		long long n_request = config.requests * (c + 1) / config.connections - config.requests * c / config.connections;
+		clients.emplace_back(run_client, std::cref(config), n_request, config.seed + c, std::ref(results[c]));
+	}
+	for (thread& client : clients)
+		client.join();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	vector<double> latencies;
+	int n_failed = 0;
+	for (const ClientResult& result : results) {
+		n_failed += result.failed;
+		latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+	}
+	if (latencies.empty()) {
+		cerr << "Error(main): No replies from " << config.socket << "." << endl;
+		return 1;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double q) { return latencies[std::min(latencies.size() - 1, (size_t)(q * latencies.size()))]; };
+
+	cout << "connections = " << config.connections << ", pipeline = " << config.pipeline << endl;
+	cout << fixed << setprecision(1) << "requests    " << latencies.size() << " in " << seconds << " s" << endl;
+	cout << "throughput  " << latencies.size() / seconds << " req/s" << endl;
+	cout << "latency     p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, max " <<
+		latencies.back() << " us" << endl;
+	if (n_failed > 0)
+		cout << n_failed << " connection(s) failed" << endl;
+	return n_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+using namespace std;
+
+/*
+	Wire format shared by inference_server and load_generator. The socket is
+	a local Unix domain socket, so every field is in host byte order.
+
+		server -> client, once:  u32 n_features | u32 n_outputs
+		client -> server:        u32 id | n_features x f32
+		server -> client:        u32 id | n_outputs x f32
+
+	A client may have any number of requests in flight on one connection;
+	replies come back in the order their batches finish, tagged with the id.
+*/
+namespace SimpleML
+{
+	bool read_exact(int fd, void* data, size_t size);
+	bool write_all(int fd, const void* data, size_t size);
+	bool make_address(const string& path, sockaddr_un& address);
+
+	/*---------------------------------------------------------------------------------------*/
+
+	bool read_exact(int fd, void* data, size_t size)
+	{
+		// false on end of stream or error
+		char* bytes = (char*)data;
+		while (size > 0) {
+			ssize_t count = recv(fd, bytes, size, 0);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return false;
+			bytes += count;
+			size -= count;
+		}
+		return true;
+	}
+
+	bool write_all(int fd, const void* data, size_t size)
+	{
+		// MSG_NOSIGNAL: a client that went away is an error, not a SIGPIPE
+		const char* bytes = (const char*)data;
+		while (size > 0) {
+			ssize_t count = send(fd, bytes, size, MSG_NOSIGNAL);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return false;
+			bytes += count;
+			size -= count;
+		}
+		return true;
+	}
+
+	bool make_address(const string& path, sockaddr_un& address)
+	{
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(address.sun_path))
+			return false;
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return true;
+	}
+}